@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <pandar_msgs/PandarPacket.h>
 
 namespace pandar_driver
@@ -13,5 +14,21 @@ public:
   };
   virtual ~Input(){};
   virtual PacketType getPacket(pandar_msgs::PandarPacket* pkt) = 0;
+
+  // Fill a preallocated slab with up to max_packets lidar packets.
+  // Returns the number of packets written, 0 on timeout or error.
+  virtual size_t getPackets(pandar_msgs::PandarPacket* packets, size_t max_packets)
+  {
+    if (max_packets == 0) {
+      return 0;
+    }
+    return getPacket(packets) == PacketType::LIDAR ? 1 : 0;
+  }
+
+  // Packets the kernel dropped because the receive buffer was full, 0 when unknown.
+  virtual uint64_t kernelDrops()
+  {
+    return 0;
+  }
 };
 }  // namespace pandar_driver
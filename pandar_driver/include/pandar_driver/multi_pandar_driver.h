@@ -0,0 +1,60 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <ros/ros.h>
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <pandar_msgs/PandarPacket.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pandar_driver
+{
+class ScanAssembler;
+
+// Receives several Pandars on one thread: every lidar port is a socket in a single epoll set, and packets are
+// demultiplexed by (source ip, lidar port) into one ScanAssembler per sensor, publishing <name>/pandar_packets.
+class MultiPandarDriver
+{
+public:
+  MultiPandarDriver(ros::NodeHandle node, ros::NodeHandle private_nh);
+  ~MultiPandarDriver();
+  bool poll(void);
+
+private:
+  struct Sensor
+  {
+    std::string name;
+    std::shared_ptr<ScanAssembler> assembler;
+  };
+  struct Port
+  {
+    int fd;
+    uint16_t port;
+  };
+
+  static uint64_t sensorKey(in_addr_t addr, uint16_t port)
+  {
+    return (static_cast<uint64_t>(addr) << 16) | port;
+  }
+  bool addPort(uint16_t port);
+  void receive(const Port& port);
+
+  int epoll_fd_;
+  int timeout_;
+  std::vector<Port> ports_;
+  std::vector<Sensor> sensors_;
+  std::unordered_map<uint64_t, size_t> sensor_index_;
+  uint64_t unknown_packets_;
+  diagnostic_updater::Updater updater_;
+
+  // recvmmsg slab shared by all ports
+  std::vector<pandar_msgs::PandarPacket> batch_;
+  std::vector<mmsghdr> msgs_;
+  std::vector<iovec> iovecs_;
+  std::vector<sockaddr_in> addrs_;
+};
+}  // namespace pandar_driver
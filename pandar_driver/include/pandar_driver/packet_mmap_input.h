@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "pandar_driver/input.h"
+
+struct tpacket3_hdr;
+
+namespace pandar_driver
+{
+// Captures lidar packets from a TPACKET_V3 ring shared with the kernel (AF_PACKET, PACKET_RX_RING).
+// A BPF program keeps only UDP datagrams from the device to the lidar port, and payloads are read
+// straight out of the mapped ring blocks. Requires CAP_NET_RAW.
+class PacketMmapInput : public Input
+{
+public:
+  PacketMmapInput(const std::string& interface, const std::string& device_ip, uint16_t port, int timeout=1000);
+  ~PacketMmapInput();
+  PacketType getPacket(pandar_msgs::PandarPacket* pkt) override;
+  size_t getPackets(pandar_msgs::PandarPacket* packets, size_t max_packets) override;
+  uint64_t kernelDrops() override;
+
+private:
+  bool attachFilter(uint32_t device_addr, uint16_t port);
+  bool nextBlock(bool wait);
+  void releaseBlock();
+
+  int fd_;
+  int timeout_;
+
+  uint8_t* ring_;
+  size_t ring_size_;
+  size_t block_size_;
+  size_t block_count_;
+
+  // block currently owned by user space, and the cursor within it
+  size_t block_index_;
+  uint8_t* block_;
+  tpacket3_hdr* next_packet_;
+  uint32_t packets_left_;
+
+  // PACKET_STATISTICS resets on every read, so the drops are accumulated here
+  uint64_t kernel_drops_;
+};
+
+}  // namespace pandar_driver
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <pandar_msgs/PandarPacket.h>
+
+namespace pandar_driver
+{
+// Fixed-capacity single-producer/single-consumer ring of preallocated packet slots.
+// The producer writes datagrams straight into the slots handed out by writable(), the consumer
+// reads them in place through readable(). Neither side takes a lock.
+// The producer and consumer indices sit on cache lines of their own; alignas only holds on the heap when
+// operator new honours it, which the package enables with -faligned-new.
+class PacketRing
+{
+public:
+  explicit PacketRing(size_t capacity);
+
+  // producer side
+  size_t writable(pandar_msgs::PandarPacket** slots);
+  void push(size_t count);
+  void addOverruns(size_t count);
+
+  // consumer side
+  size_t readable(const pandar_msgs::PandarPacket** slots);
+  void pop(size_t count);
+
+  size_t capacity() const
+  {
+    return mask_ + 1;
+  }
+  size_t occupancy() const;
+  size_t highWater() const
+  {
+    return high_water_.load(std::memory_order_relaxed);
+  }
+  uint64_t received() const
+  {
+    return received_.load(std::memory_order_relaxed);
+  }
+  uint64_t overruns() const
+  {
+    return overruns_.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+
+  std::vector<pandar_msgs::PandarPacket> slots_;
+  size_t mask_;
+
+  // producer owned
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_;
+  size_t cached_tail_;
+  std::atomic<size_t> high_water_;
+  std::atomic<uint64_t> received_;
+  std::atomic<uint64_t> overruns_;
+
+  // consumer owned
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_;
+  size_t cached_head_;
+};
+
+inline PacketRing::PacketRing(size_t capacity)
+  : head_(0), cached_tail_(0), high_water_(0), received_(0), overruns_(0), tail_(0), cached_head_(0)
+{
+  // round up to a power of two so that indices wrap with a mask
+  size_t rounded = 1;
+  while (rounded < capacity) {
+    rounded <<= 1;
+  }
+  slots_.resize(rounded);
+  mask_ = rounded - 1;
+}
+
+inline size_t PacketRing::writable(pandar_msgs::PandarPacket** slots)
+{
+  const size_t head = head_.load(std::memory_order_relaxed);
+  if (head - cached_tail_ == capacity()) {
+    cached_tail_ = tail_.load(std::memory_order_acquire);
+  }
+  const size_t free_slots = capacity() - (head - cached_tail_);
+  const size_t index = head & mask_;
+  *slots = &slots_[index];
+  // contiguous run up to the end of the slot array
+  return std::min(free_slots, capacity() - index);
+}
+
+inline void PacketRing::push(size_t count)
+{
+  if (count == 0) {
+    return;
+  }
+  const size_t head = head_.load(std::memory_order_relaxed) + count;
+  head_.store(head, std::memory_order_release);
+  received_.fetch_add(count, std::memory_order_relaxed);
+
+  const size_t used = head - tail_.load(std::memory_order_relaxed);
+  if (used > high_water_.load(std::memory_order_relaxed)) {
+    high_water_.store(used, std::memory_order_relaxed);
+  }
+}
+
+inline void PacketRing::addOverruns(size_t count)
+{
+  overruns_.fetch_add(count, std::memory_order_relaxed);
+}
+
+inline size_t PacketRing::readable(const pandar_msgs::PandarPacket** slots)
+{
+  const size_t tail = tail_.load(std::memory_order_relaxed);
+  if (cached_head_ == tail) {
+    cached_head_ = head_.load(std::memory_order_acquire);
+  }
+  const size_t index = tail & mask_;
+  *slots = &slots_[index];
+  return std::min(cached_head_ - tail, capacity() - index);
+}
+
+inline void PacketRing::pop(size_t count)
+{
+  tail_.store(tail_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+inline size_t PacketRing::occupancy() const
+{
+  return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+}
+
+}  // namespace pandar_driver
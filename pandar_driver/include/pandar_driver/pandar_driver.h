@@ -1,11 +1,17 @@
 #pragma once
 
 #include <ros/ros.h>
+#include <diagnostic_updater/diagnostic_updater.h>
 #include <pandar_api/tcp_client.hpp>
+#include <pandar_msgs/PandarPacket.h>
+#include <vector>
 
 namespace pandar_driver
 {
 class Input;
+class ThreadedInput;
+class ScanAssembler;
+class PcapWriter;
 class PandarDriver
 {
 public:
@@ -14,20 +20,32 @@ public:
   bool poll(void);
 
 private:
+  void checkPackets(diagnostic_updater::DiagnosticStatusWrapper& stat);
+
   std::string device_ip_;
   int lidar_port_;
   int gps_port_;
   double scan_phase_;
-  size_t azimuth_index_;
+  bool compact_scan_;
 
   std::string model_;
   std::string frame_id_;
   std::string pcap_path_;
 
-  ros::Publisher pandar_packet_pub_;
+  std::shared_ptr<ScanAssembler> assembler_;
   std::shared_ptr<Input> input_;
+  std::shared_ptr<ThreadedInput> threaded_input_;
+  std::shared_ptr<PcapWriter> recorder_;
+  uint64_t reported_overruns_;
+  uint64_t reported_record_drops_;
   std::shared_ptr<pandar_api::TCPClient> client_;
+  diagnostic_updater::Updater updater_;
 
-  std::function<bool(size_t)> is_valid_packet_;
+  // packets received in the last batch, consumed across scan boundaries. batch_packets_ points into batch_, or
+  // into the receive ring with threaded_input_.
+  std::vector<pandar_msgs::PandarPacket> batch_;
+  const pandar_msgs::PandarPacket* batch_packets_;
+  size_t batch_head_;
+  size_t batch_count_;
 };
 }  // namespace pandar_driver
\ No newline at end of file
@@ -15,35 +15,83 @@
  *****************************************************************************/
 #pragma once
 
-#include <pcap.h>
+#include <chrono>
+#include <cstdint>
+#include <map>
 #include <string>
+#include <vector>
 #include "pandar_driver/input.h"
 
 namespace pandar_driver
 {
+// Replays a pcap capture without libpcap. The file is mmapped, and the offsets of the UDP payloads sent
+// to the lidar port are indexed once and cached next to the capture as <path>.idx.
 class PcapInput : public Input
 {
 public:
-  PcapInput(uint16_t port, uint16_t gps_port, std::string path, std::string model);
+  // a UDP payload inside the mapped capture
+  struct PacketView
+  {
+    const uint8_t* data;
+    uint32_t size;
+  };
+
+  // replay_rate: 1.0 replays in real time, N at N times speed, 0 as fast as possible
+  PcapInput(uint16_t port, uint16_t gps_port, std::string path, std::string model, double replay_rate = 1.0);
   ~PcapInput();
 
   PacketType getPacket(pandar_msgs::PandarPacket* pandar_pkt) override;
+  size_t getPackets(pandar_msgs::PandarPacket* packets, size_t max_packets) override;
+
+  // zero-copy access, valid while the input is alive
+  bool nextView(PacketView* view);
+  size_t packetNum() const { return index_.size(); }
+  void seek(size_t packet_index) { next_index_ = packet_index; }
 
 private:
+  struct IndexEntry
+  {
+    uint64_t offset;
+    uint32_t size;
+  };
+
   void initTimeIndexMap();
+  bool mapFile();
+  bool loadIndex(const std::string& index_path);
+  void buildIndex();
+  void saveIndex(const std::string& index_path) const;
+  bool sensorTime(const uint8_t* packet, uint32_t size, int64_t* usec);
+  void throttle(const uint8_t* packet, uint32_t size);
+  void reportReplay();
+
   std::string pcap_path_;
   std::string frame_id_;
+  uint16_t port_;
+  double replay_rate_;
   int ts_index_;
   int utc_index_;
   std::map<std::string, std::pair<int, int>> time_index_map_;
 
-  pcap_t* pcap_;
-  char errbuf_[PCAP_ERRBUF_SIZE];
-  bpf_program pcap_filter_;
+  int fd_;
+  const uint8_t* file_;
+  size_t file_size_;
+  int64_t file_mtime_;
+  std::vector<IndexEntry> index_;
+  size_t next_index_;
+
+  uint8_t cached_utc_[6];
+  int64_t cached_utc_sec_;
 
-  size_t packet_count_;
-  int64_t last_pkt_ts_;
-  int64_t last_time_;
+  // replay pacing and statistics
+  bool replay_started_;
+  std::chrono::steady_clock::time_point replay_start_;
+  std::chrono::steady_clock::time_point anchor_time_;
+  int64_t first_sensor_us_;
+  int64_t last_sensor_us_;
+  int64_t anchor_sensor_us_;
+  size_t replayed_packets_;
+  uint64_t replayed_bytes_;
+  bool end_reported_;
 };
 
 }  // namespace pandar_driver
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pandar_driver/packet_ring.h"
+
+namespace pandar_driver
+{
+// Records lidar datagrams to rotating pcap files from a background thread.
+// write() only copies into a PacketRing and never blocks; when the ring is full the packet is dropped and
+// counted. Ethernet/IPv4/UDP headers are synthesised from the device address and lidar port, so the
+// files replay through PcapInput.
+class PcapWriter
+{
+public:
+  PcapWriter(const std::string& prefix, const std::string& device_ip, uint16_t port, size_t queue_capacity,
+             size_t rotate_bytes);
+  ~PcapWriter();
+
+  void write(const pandar_msgs::PandarPacket* packets, size_t count);
+
+  uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+  uint64_t dropped() const { return queue_.overruns(); }
+
+private:
+  void writeLoop();
+  bool openFile();
+  void closeFile();
+  void writeRecord(const pandar_msgs::PandarPacket& packet);
+
+  std::string prefix_;
+  uint32_t device_addr_;
+  uint16_t port_;
+  size_t rotate_bytes_;
+
+  PacketRing queue_;
+  std::atomic<uint64_t> written_;
+
+  FILE* file_;
+  size_t file_index_;
+  size_t file_bytes_;
+  std::vector<char> file_buffer_;
+
+  std::atomic<bool> running_;
+  std::thread writer_thread_;
+};
+
+}  // namespace pandar_driver
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <ros/ros.h>
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <pandar_msgs/PandarCompactScan.h>
+#include <pandar_msgs/PandarPacket.h>
+#include <pandar_msgs/PandarScan.h>
+#include "pandar_driver/sequence_tracker.h"
+#include <functional>
+#include <string>
+
+namespace pandar_driver
+{
+// Collects packets of one sensor into a scan and publishes it once the azimuth wraps past scan_phase.
+// With sector_degrees > 0 a scan is also cut whenever the azimuth enters the next sector, so rotations are
+// published as sector_count slices tagged with sector_index.
+class ScanAssembler
+{
+public:
+  ScanAssembler(ros::NodeHandle node, const std::string& model, const std::string& frame_id, double scan_phase,
+                bool compact_scan, double sector_degrees = 0.0);
+
+  bool isValidPacket(size_t packet_size) const { return is_valid_packet_ && is_valid_packet_(packet_size); }
+  // Appends a packet to the current scan, returns true when this packet completed it.
+  // Duplicated packets (same udp_sequence) are dropped.
+  bool addPacket(const pandar_msgs::PandarPacket& packet);
+  void publish();
+
+  const SequenceTracker& sequence() const { return sequence_; }
+  // packet accounting since the previous call, for a diagnostic_updater task
+  void diagnose(diagnostic_updater::DiagnosticStatusWrapper& stat);
+
+private:
+  void resetScan();
+
+  std::string frame_id_;
+  int scan_phase_;
+  bool compact_scan_;
+  // sector width in 0.01 degrees, 0 when publishing full rotations
+  int sector_width_;
+  uint16_t sector_count_;
+  size_t azimuth_index_;
+  std::function<bool(size_t)> is_valid_packet_;
+  // offset of udp_sequence for a packet size, -1 when the packet carries none
+  std::function<int(size_t)> sequence_index_;
+
+  ros::Publisher pandar_packet_pub_;
+  pandar_msgs::PandarScanPtr scan_;
+  pandar_msgs::PandarCompactScanPtr compact_scan_msg_;
+  ros::Time scan_stamp_;
+  size_t packet_count_;
+  int prev_phase_;
+  uint16_t scan_sector_;
+
+  SequenceTracker sequence_;
+  uint64_t scan_lost_;
+  uint64_t scan_duplicated_;
+  uint64_t scan_reordered_;
+  uint64_t diag_received_;
+  uint64_t diag_lost_;
+};
+}  // namespace pandar_driver
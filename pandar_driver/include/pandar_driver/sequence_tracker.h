@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace pandar_driver
+{
+// Accounts for the udp_sequence field of the packet tail.
+// A gap counts as lost, a late packet that fills a gap moves from lost to reordered, and a sequence number
+// seen again within the window counts as duplicated.
+class SequenceTracker
+{
+public:
+  enum class Result {
+    IN_ORDER,
+    GAP,
+    REORDERED,
+    DUPLICATE,
+    RESYNC
+  };
+
+  SequenceTracker() : started_(false), expected_(0), received_(0), lost_(0), duplicated_(0), reordered_(0)
+  {
+    seen_.fill(0);
+  }
+
+  Result update(uint32_t sequence)
+  {
+    ++received_;
+    if (!started_) {
+      resync(sequence);
+      return Result::RESYNC;
+    }
+
+    const int64_t diff = static_cast<int32_t>(sequence - expected_);
+    if (diff >= 0 && diff < MAX_GAP) {
+      lost_ += static_cast<uint64_t>(diff);
+      expected_ = sequence + 1;
+      mark(sequence);
+      return diff == 0 ? Result::IN_ORDER : Result::GAP;
+    }
+    if (diff < 0 && -diff <= static_cast<int64_t>(WINDOW)) {
+      if (seen(sequence)) {
+        ++duplicated_;
+        return Result::DUPLICATE;
+      }
+      mark(sequence);
+      if (lost_ > 0) {
+        --lost_;
+      }
+      ++reordered_;
+      return Result::REORDERED;
+    }
+    // sensor restart or a jump too large to be loss
+    resync(sequence);
+    return Result::RESYNC;
+  }
+
+  uint64_t received() const { return received_; }
+  uint64_t lost() const { return lost_; }
+  uint64_t duplicated() const { return duplicated_; }
+  uint64_t reordered() const { return reordered_; }
+
+private:
+  static constexpr uint32_t WINDOW = 4096;
+  static constexpr int64_t MAX_GAP = 1 << 16;
+
+  void resync(uint32_t sequence)
+  {
+    started_ = true;
+    seen_.fill(0);
+    expected_ = sequence + 1;
+    mark(sequence);
+  }
+  // slots hold sequence + 1 so that 0 means empty
+  void mark(uint32_t sequence) { seen_[sequence % WINDOW] = sequence + 1; }
+  bool seen(uint32_t sequence) const { return seen_[sequence % WINDOW] == sequence + 1; }
+
+  bool started_;
+  uint32_t expected_;
+  std::array<uint32_t, WINDOW> seen_;
+
+  uint64_t received_;
+  uint64_t lost_;
+  uint64_t duplicated_;
+  uint64_t reordered_;
+};
+}  // namespace pandar_driver
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <array>
+#include <atomic>
 #include <string>
+#include <vector>
 #include <boost/asio.hpp>
 #include "pandar_driver/input.h"
 
@@ -11,9 +16,15 @@ using boost::asio::ip::udp;
 class SocketInput : public Input
 {
 public:
-  SocketInput(const std::string& device_ip, uint16_t port, uint16_t gps_port, int timeout=1000);
+  SocketInput(const std::string& device_ip, uint16_t port, uint16_t gps_port, int timeout=1000,
+              bool kernel_timestamp=false);
   ~SocketInput();
   PacketType getPacket(pandar_msgs::PandarPacket* pkt) override;
+  size_t getPackets(pandar_msgs::PandarPacket* packets, size_t max_packets) override;
+  uint64_t kernelDrops() override
+  {
+    return kernel_drops_.load(std::memory_order_relaxed);
+  }
 
 private:
   // void on_receive();
@@ -26,6 +37,16 @@ private:
 
   boost::asio::ip::address device_ip_;
   int timeout_;
+  // stamp packets with the kernel arrival time (SO_TIMESTAMPNS) instead of ros::Time::now()
+  bool kernel_timestamp_;
+  // socket overflow counter reported by SO_RXQ_OVFL
+  std::atomic<uint64_t> kernel_drops_;
+
+  // recvmmsg descriptors, grown to the largest batch requested
+  std::vector<mmsghdr> msgs_;
+  std::vector<iovec> iovecs_;
+  std::vector<sockaddr_in> addrs_;
+  std::vector<std::array<char, CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(uint32_t))>> controls_;
 };
 
 }  // namespace pandar_driver
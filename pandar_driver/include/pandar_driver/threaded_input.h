@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "pandar_driver/input.h"
+#include "pandar_driver/packet_ring.h"
+
+namespace pandar_driver
+{
+// Runs another Input on a dedicated (optionally pinned) receive thread and hands its packets
+// to the poll thread through a PacketRing. The poll thread sleeps on a condition variable while the ring is
+// empty and the receive thread only signals it when it is actually waiting.
+class ThreadedInput : public Input
+{
+public:
+  struct Stats
+  {
+    size_t capacity;
+    size_t occupancy;
+    size_t high_water;
+    uint64_t received;
+    uint64_t overruns;
+  };
+
+  ThreadedInput(std::shared_ptr<Input> input, size_t capacity, size_t batch_size, int cpu = -1, int timeout = 1000);
+  ~ThreadedInput();
+
+  PacketType getPacket(pandar_msgs::PandarPacket* pkt) override;
+  size_t getPackets(pandar_msgs::PandarPacket* packets, size_t max_packets) override;
+  // Point packets at up to max_packets received packets, read in place in the ring. They stay valid until
+  // release() hands the slots back. Returns 0 on timeout.
+  size_t acquire(const pandar_msgs::PandarPacket** packets, size_t max_packets);
+  void release(size_t count);
+  uint64_t kernelDrops() override
+  {
+    return input_->kernelDrops();
+  }
+  Stats getStats() const;
+
+private:
+  void receiveLoop();
+  void wakeConsumer();
+
+  std::shared_ptr<Input> input_;
+  PacketRing ring_;
+  std::vector<pandar_msgs::PandarPacket> overrun_slab_;
+  size_t batch_size_;
+  int timeout_;
+
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::atomic<bool> waiting_;
+
+  std::atomic<bool> running_;
+  std::thread receive_thread_;
+};
+
+}  // namespace pandar_driver
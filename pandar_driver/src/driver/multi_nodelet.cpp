@@ -0,0 +1,56 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <ros/ros.h>
+#include <string>
+#include <thread>
+
+#include <pandar_driver/multi_pandar_driver.h>
+
+namespace pandar_driver
+{
+class MultiDriverNodelet : public nodelet::Nodelet
+{
+public:
+  MultiDriverNodelet() : running_(false)
+  {
+  }
+
+  ~MultiDriverNodelet()
+  {
+    NODELET_INFO("shutting down multi driver thread");
+    running_ = false;
+    if (deviceThread_.joinable()) {
+      deviceThread_.join();
+    }
+    NODELET_INFO("multi driver thread stopped");
+  }
+
+private:
+  virtual void onInit(void);
+  virtual void devicePoll(void);
+
+  volatile bool running_;
+  std::thread deviceThread_;
+  std::shared_ptr<MultiPandarDriver> driver_;
+};
+
+void MultiDriverNodelet::onInit()
+{
+  driver_.reset(new MultiPandarDriver(getNodeHandle(), getPrivateNodeHandle()));
+
+  running_ = true;
+  deviceThread_ = std::thread(&MultiDriverNodelet::devicePoll, this);
+}
+
+void MultiDriverNodelet::devicePoll()
+{
+  while (ros::ok() && running_) {
+    if (!driver_->poll())
+      break;
+  }
+  running_ = false;
+}
+
+}  // namespace pandar_driver
+
+PLUGINLIB_EXPORT_CLASS(pandar_driver::MultiDriverNodelet, nodelet::Nodelet)
@@ -0,0 +1,195 @@
+#include <pandar_driver/multi_pandar_driver.h>
+#include <pandar_driver/scan_assembler.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+using namespace pandar_driver;
+
+namespace
+{
+const size_t ETHERNET_MTU = 1500;
+const int MAX_EVENTS = 16;
+}  // namespace
+
+MultiPandarDriver::MultiPandarDriver(ros::NodeHandle node, ros::NodeHandle private_nh)
+  : timeout_(1000), unknown_packets_(0)
+{
+  int batch_size;
+  bool compact_scan;
+  double sector_degrees;
+  XmlRpc::XmlRpcValue sensors;
+  private_nh.param("batch_size", batch_size, 32);
+  private_nh.param("compact_scan", compact_scan, false);
+  private_nh.param("sector_degrees", sector_degrees, 0.0);
+
+  batch_.resize(std::max(batch_size, 1));
+  msgs_.resize(batch_.size());
+  iovecs_.resize(batch_.size());
+  addrs_.resize(batch_.size());
+
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    ROS_ERROR("epoll_create1 failed: %s", strerror(errno));
+    return;
+  }
+
+  if (!private_nh.getParam("sensors", sensors) || sensors.getType() != XmlRpc::XmlRpcValue::TypeArray) {
+    ROS_ERROR("~sensors must be a list of {name, device_ip, lidar_port, model[, frame_id, scan_phase]}");
+    return;
+  }
+
+  for (int i = 0; i < sensors.size(); ++i) {
+    XmlRpc::XmlRpcValue& config = sensors[i];
+    if (config.getType() != XmlRpc::XmlRpcValue::TypeStruct || !config.hasMember("name") ||
+        !config.hasMember("device_ip") || !config.hasMember("lidar_port") || !config.hasMember("model")) {
+      ROS_ERROR("sensor %d: name, device_ip, lidar_port and model are required", i);
+      continue;
+    }
+    std::string name = static_cast<std::string&>(config["name"]);
+    std::string device_ip = static_cast<std::string&>(config["device_ip"]);
+    int lidar_port = static_cast<int&>(config["lidar_port"]);
+    std::string model = static_cast<std::string&>(config["model"]);
+    std::string frame_id = config.hasMember("frame_id") ? static_cast<std::string&>(config["frame_id"]) : name;
+    double scan_phase = 0.0;
+    if (config.hasMember("scan_phase")) {
+      XmlRpc::XmlRpcValue& phase = config["scan_phase"];
+      scan_phase = phase.getType() == XmlRpc::XmlRpcValue::TypeInt ? static_cast<int&>(phase)
+                                                                    : static_cast<double&>(phase);
+    }
+
+    in_addr addr{};
+    if (inet_pton(AF_INET, device_ip.c_str(), &addr) != 1 || lidar_port <= 0 || lidar_port > 0xffff) {
+      ROS_ERROR("sensor %s: invalid device_ip %s or lidar_port %d", name.c_str(), device_ip.c_str(), lidar_port);
+      continue;
+    }
+    const uint64_t key = sensorKey(addr.s_addr, static_cast<uint16_t>(lidar_port));
+    if (sensor_index_.count(key)) {
+      ROS_ERROR("sensor %s: %s:%d is already used by %s", name.c_str(), device_ip.c_str(), lidar_port,
+                sensors_[sensor_index_[key]].name.c_str());
+      continue;
+    }
+    bool port_open = std::any_of(ports_.begin(), ports_.end(), [lidar_port](const Port& port) {
+      return port.port == lidar_port;
+    });
+    if (!port_open && !addPort(static_cast<uint16_t>(lidar_port))) {
+      continue;
+    }
+
+    Sensor sensor;
+    sensor.name = name;
+    sensor.assembler.reset(
+        new ScanAssembler(ros::NodeHandle(node, name), model, frame_id, scan_phase, compact_scan,
+                          sector_degrees));
+    sensor_index_[key] = sensors_.size();
+    sensors_.push_back(sensor);
+    updater_.add(name + "_packets",
+                 std::bind(&ScanAssembler::diagnose, sensor.assembler.get(), std::placeholders::_1));
+    ROS_INFO("sensor %s: %s %s:%d", name.c_str(), model.c_str(), device_ip.c_str(), lidar_port);
+  }
+  updater_.setHardwareID("pandar");
+}
+
+MultiPandarDriver::~MultiPandarDriver()
+{
+  for (const auto& port : ports_) {
+    close(port.fd);
+  }
+  if (epoll_fd_ >= 0) {
+    close(epoll_fd_);
+  }
+}
+
+bool MultiPandarDriver::addPort(uint16_t port)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    ROS_ERROR("socket failed: %s", strerror(errno));
+    return false;
+  }
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    ROS_ERROR("bind to port %d failed: %s", port, strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.u32 = static_cast<uint32_t>(ports_.size());
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+    ROS_ERROR("epoll_ctl failed: %s", strerror(errno));
+    close(fd);
+    return false;
+  }
+  ports_.push_back({ fd, port });
+  return true;
+}
+
+bool MultiPandarDriver::poll(void)
+{
+  if (ports_.empty()) {
+    ros::Duration(timeout_ / 1000.0).sleep();
+    return true;
+  }
+
+  epoll_event events[MAX_EVENTS];
+  int ready = epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout_);
+  if (ready < 0 && errno != EINTR) {
+    ROS_ERROR_THROTTLE(1.0, "epoll_wait failed: %s", strerror(errno));
+  }
+  // one batch per ready port and round, so a busy sensor cannot starve the others
+  for (int i = 0; i < ready; ++i) {
+    receive(ports_[events[i].data.u32]);
+  }
+  updater_.update();
+  return true;
+}
+
+void MultiPandarDriver::receive(const Port& port)
+{
+  const size_t batch_size = batch_.size();
+  for (size_t i = 0; i < batch_size; ++i) {
+    iovecs_[i].iov_base = batch_[i].data.data();
+    iovecs_[i].iov_len = ETHERNET_MTU;
+    msgs_[i].msg_hdr = {};
+    msgs_[i].msg_hdr.msg_name = &addrs_[i];
+    msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    msgs_[i].msg_hdr.msg_iov = &iovecs_[i];
+    msgs_[i].msg_hdr.msg_iovlen = 1;
+    msgs_[i].msg_len = 0;
+  }
+
+  int received = recvmmsg(port.fd, msgs_.data(), static_cast<unsigned int>(batch_size), MSG_DONTWAIT, nullptr);
+  if (received <= 0) {
+    return;
+  }
+
+  const ros::Time stamp = ros::Time::now();
+  for (size_t i = 0; i < static_cast<size_t>(received); ++i) {
+    auto sensor = sensor_index_.find(sensorKey(addrs_[i].sin_addr.s_addr, port.port));
+    if (sensor == sensor_index_.end()) {
+      ++unknown_packets_;
+      ROS_WARN_THROTTLE(5.0, "%lu packets on port %d from unconfigured sources (last %s)", unknown_packets_,
+                        port.port, inet_ntoa(addrs_[i].sin_addr));
+      continue;
+    }
+    auto& packet = batch_[i];
+    packet.stamp = stamp;
+    packet.size = msgs_[i].msg_len;
+
+    ScanAssembler& assembler = *sensors_[sensor->second].assembler;
+    if (assembler.isValidPacket(packet.size) && assembler.addPacket(packet)) {
+      assembler.publish();
+    }
+  }
+}
@@ -1,14 +1,31 @@
 #include <pandar_driver/pandar_driver.h>
 #include <pandar_driver/input.h>
+#include <pandar_driver/packet_mmap_input.h>
 #include <pandar_driver/pcap_input.h>
+#include <pandar_driver/pcap_writer.h>
+#include <pandar_driver/scan_assembler.h>
 #include <pandar_driver/socket_input.h>
+#include <pandar_driver/threaded_input.h>
 #include <pandar_msgs/PandarPacket.h>
-#include <pandar_msgs/PandarScan.h>
+#include <algorithm>
 
 using namespace pandar_driver;
 
 PandarDriver::PandarDriver(ros::NodeHandle node, ros::NodeHandle private_nh)
+  : reported_overruns_(0), reported_record_drops_(0), batch_packets_(nullptr), batch_head_(0), batch_count_(0)
 {
+  int batch_size;
+  bool receive_thread;
+  int ring_capacity;
+  int receive_cpu;
+  bool kernel_timestamp;
+  std::string input_type;
+  std::string interface;
+  double replay_rate;
+  std::string record_pcap;
+  int record_rotate_mb;
+  int record_queue;
+  double sector_degrees;
   private_nh.getParam("pcap", pcap_path_);
   private_nh.getParam("device_ip", device_ip_);
   private_nh.getParam("lidar_port", lidar_port_);
@@ -16,84 +33,109 @@ PandarDriver::PandarDriver(ros::NodeHandle node, ros::NodeHandle private_nh)
   private_nh.getParam("scan_phase", scan_phase_);
   private_nh.getParam("model", model_);
   private_nh.getParam("frame_id", frame_id_);
+  private_nh.param("batch_size", batch_size, 32);
+  private_nh.param("receive_thread", receive_thread, false);
+  private_nh.param("ring_capacity", ring_capacity, 4096);
+  private_nh.param("receive_cpu", receive_cpu, -1);
+  private_nh.param("compact_scan", compact_scan_, false);
+  private_nh.param("sector_degrees", sector_degrees, 0.0);
+  private_nh.param("kernel_timestamp", kernel_timestamp, false);
+  private_nh.param<std::string>("input_type", input_type, pcap_path_.empty() ? "socket" : "pcap");
+  private_nh.param<std::string>("interface", interface, "eth0");
+  private_nh.param("replay_rate", replay_rate, 1.0);
+  private_nh.param<std::string>("record_pcap", record_pcap, "");
+  private_nh.param("record_rotate_mb", record_rotate_mb, 1024);
+  private_nh.param("record_queue", record_queue, 16384);
 
-  pandar_packet_pub_ = node.advertise<pandar_msgs::PandarScan>("pandar_packets", 10);
+  batch_.resize(std::max(batch_size, 1));
 
-  if (!pcap_path_.empty()) {
-    input_.reset(new PcapInput(lidar_port_, gps_port_, pcap_path_, model_));
+  assembler_.reset(new ScanAssembler(node, model_, frame_id_, scan_phase_, compact_scan_, sector_degrees));
+
+  if (input_type == "pcap") {
+    input_.reset(new PcapInput(lidar_port_, gps_port_, pcap_path_, model_, replay_rate));
   }
   else {
-    input_.reset(new SocketInput(device_ip_, lidar_port_, gps_port_));
+    if (input_type == "packet_mmap") {
+      input_.reset(new PacketMmapInput(interface, device_ip_, lidar_port_));
+    }
+    else {
+      if (input_type != "socket") {
+        ROS_ERROR("Invalid input_type %s, falling back to socket", input_type.c_str());
+      }
+      input_.reset(new SocketInput(device_ip_, lidar_port_, gps_port_, 1000, kernel_timestamp));
+    }
+    if (receive_thread) {
+      threaded_input_ = std::make_shared<ThreadedInput>(input_, ring_capacity, batch_.size(), receive_cpu);
+      input_ = threaded_input_;
+    }
+    if (!record_pcap.empty()) {
+      recorder_ = std::make_shared<PcapWriter>(record_pcap, device_ip_, lidar_port_, std::max(record_queue, 1),
+                                               static_cast<size_t>(std::max(record_rotate_mb, 0)) << 20);
+    }
   }
 
   client_ = std::make_shared<pandar_api::TCPClient>(device_ip_);
   // uint16_t range[2];
 
-  if (model_ == "Pandar40P" || model_ == "Pandar40M") {
-    azimuth_index_ = 2;  // 2 + 124 * [0-9]
-    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 1262 || packet_size == 1266); };
-  }
-  else if (model_ == "PandarQT") {
-    azimuth_index_ = 12;  // 12 + 258 * [0-3]
-    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 1072); };
-  }
-  else  if (model_ == "PandarXT-32") {
-    azimuth_index_ = 12;  // 12 + 130 * [0-7]
-    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 1080); };
-  }
-  else if (model_ == "Pandar64") {
-    azimuth_index_ = 8;  // 8 + 192 * [0-5]
-    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 1194 || packet_size == 1198); };
-  }
-  else if (model_ == "Pandar128E4X") {
-    azimuth_index_ = 12;  // 12 + 386 * [0-1]
-    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 1117 || packet_size == 861); };
-  }
-  else if (model_ == "PandarXTM") {
-    azimuth_index_ = 12;  // 12 + 130 * [0-7]
-    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 820); };
-  }
-  else if (model_ == "PandarQT128") {
-    azimuth_index_ = 12;  // 12 + 512 * [0-1]
-    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 1127); };
+  updater_.setHardwareIDf("%s: %s", model_.c_str(), device_ip_.c_str());
+  updater_.add("pandar_packets", this, &PandarDriver::checkPackets);
+}
+
+void PandarDriver::checkPackets(diagnostic_updater::DiagnosticStatusWrapper& stat)
+{
+  // sequence gaps are loss anywhere between sensor and socket; kernel drops and ring overruns narrow it down
+  assembler_->diagnose(stat);
+  stat.add("kernel drops", input_->kernelDrops());
+  if (threaded_input_) {
+    stat.add("ring overruns", threaded_input_->getStats().overruns);
   }
-  else {
-    ROS_ERROR("Invalid model name");
+  if (recorder_) {
+    stat.add("recorded", recorder_->written());
+    stat.add("recorder drops", recorder_->dropped());
   }
 }
 
 bool PandarDriver::poll(void)
 {
-  int scan_phase = static_cast<int>(scan_phase_ * 100.0);
-
-  pandar_msgs::PandarScanPtr scan(new pandar_msgs::PandarScan);
-  for (int prev_phase = 0;;) {  // finish scan
-    while (true) {              // until receive lidar packet
-      pandar_msgs::PandarPacket packet;
-      Input::PacketType packet_type = input_->getPacket(&packet);
-      if (packet_type == Input::PacketType::LIDAR && is_valid_packet_(packet.size)) {
-        scan->packets.push_back(packet);
-        break;
+  while (true) {  // finish scan
+    if (batch_head_ == batch_count_) {
+      if (threaded_input_) {
+        // read the packets in place and hand the slots back once the whole batch is assembled
+        threaded_input_->release(batch_count_);
+        batch_count_ = threaded_input_->acquire(&batch_packets_, batch_.size());
       }
+      else {
+        batch_count_ = input_->getPackets(batch_.data(), batch_.size());
+        batch_packets_ = batch_.data();
+      }
+      batch_head_ = 0;
+      if (recorder_) {
+        recorder_->write(batch_packets_, batch_count_);
+      }
+      continue;
     }
-
-    int current_phase = 0;
-    {
-      const auto& data = scan->packets.back().data;
-      current_phase = (data[azimuth_index_] & 0xff) | ((data[azimuth_index_ + 1] & 0xff) << 8);
-      current_phase = (static_cast<int>(current_phase) + 36000 - scan_phase) % 36000;
-    }
-    if (current_phase >= prev_phase || scan->packets.size() < 2) {
-      prev_phase = current_phase;
-    }
-    else {
-      // has scanned !
+    const pandar_msgs::PandarPacket& packet = batch_packets_[batch_head_++];
+    if (assembler_->isValidPacket(packet.size) && assembler_->addPacket(packet)) {
       break;
     }
   }
+  assembler_->publish();
+  updater_.update();
 
-  scan->header.stamp = scan->packets.front().stamp;
-  scan->header.frame_id = frame_id_;
-  pandar_packet_pub_.publish(scan);
+  if (threaded_input_) {
+    auto stats = threaded_input_->getStats();
+    ROS_DEBUG_THROTTLE(5.0, "receive ring occupancy %zu/%zu (peak %zu), %lu received, %lu overruns", stats.occupancy,
+                       stats.capacity, stats.high_water, stats.received, stats.overruns);
+    if (stats.overruns > reported_overruns_) {
+      ROS_WARN_THROTTLE(1.0, "receive ring overrun: %lu packets dropped (capacity %zu)",
+                        stats.overruns - reported_overruns_, stats.capacity);
+      reported_overruns_ = stats.overruns;
+    }
+  }
+  if (recorder_ && recorder_->dropped() > reported_record_drops_) {
+    ROS_WARN_THROTTLE(1.0, "pcap recorder queue full: %lu packets not recorded",
+                      recorder_->dropped() - reported_record_drops_);
+    reported_record_drops_ = recorder_->dropped();
+  }
   return true;
 }
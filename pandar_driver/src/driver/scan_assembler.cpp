@@ -0,0 +1,179 @@
+#include <pandar_driver/scan_assembler.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace pandar_driver;
+
+ScanAssembler::ScanAssembler(ros::NodeHandle node, const std::string& model, const std::string& frame_id,
+                             double scan_phase, bool compact_scan, double sector_degrees)
+  : frame_id_(frame_id), scan_phase_(static_cast<int>(scan_phase * 100.0)), compact_scan_(compact_scan),
+    sector_width_(0), sector_count_(0), azimuth_index_(0), packet_count_(0), prev_phase_(0), scan_sector_(0),
+    scan_lost_(0), scan_duplicated_(0), scan_reordered_(0), diag_received_(0), diag_lost_(0)
+{
+  if (sector_degrees > 0.0) {
+    sector_width_ = std::min(std::max(static_cast<int>(std::lround(sector_degrees * 100.0)), 1), 36000);
+    sector_count_ = static_cast<uint16_t>((36000 + sector_width_ - 1) / sector_width_);
+    ROS_INFO("publishing %d sectors of %.2f degrees", sector_count_, sector_width_ / 100.0);
+  }
+
+  if (compact_scan_) {
+    pandar_packet_pub_ = node.advertise<pandar_msgs::PandarCompactScan>("pandar_compact_packets", 10);
+  }
+  else {
+    pandar_packet_pub_ = node.advertise<pandar_msgs::PandarScan>("pandar_packets", 10);
+  }
+
+  if (model == "Pandar40P" || model == "Pandar40M") {
+    azimuth_index_ = 2;  // 2 + 124 * [0-9]
+    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 1262 || packet_size == 1266); };
+    sequence_index_ = [](size_t packet_size) { return packet_size == 1266 ? 1262 : -1; };
+  }
+  else if (model == "PandarQT") {
+    azimuth_index_ = 12;  // 12 + 258 * [0-3]
+    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 1072); };
+    sequence_index_ = [](size_t) { return 1068; };
+  }
+  else  if (model == "PandarXT-32") {
+    azimuth_index_ = 12;  // 12 + 130 * [0-7]
+    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 1080); };
+    sequence_index_ = [](size_t) { return 1076; };
+  }
+  else if (model == "Pandar64") {
+    azimuth_index_ = 8;  // 8 + 192 * [0-5]
+    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 1194 || packet_size == 1198); };
+    sequence_index_ = [](size_t packet_size) { return packet_size == 1198 ? 1194 : -1; };
+  }
+  else if (model == "Pandar128E4X") {
+    azimuth_index_ = 12;  // 12 + 386 * [0-1]
+    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 1117 || packet_size == 861); };
+    sequence_index_ = [](size_t packet_size) { return static_cast<int>(packet_size) - 30; };  // Tail::udp_sequence
+  }
+  else if (model == "PandarXTM") {
+    azimuth_index_ = 12;  // 12 + 130 * [0-7]
+    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 820); };
+    sequence_index_ = [](size_t) { return 816; };
+  }
+  else if (model == "PandarQT128") {
+    azimuth_index_ = 12;  // 12 + 512 * [0-1]
+    is_valid_packet_ = [](size_t packet_size) { return (packet_size == 1127); };
+    sequence_index_ = [](size_t) { return 1087; };
+  }
+  else {
+    ROS_ERROR("Invalid model name");
+  }
+
+  resetScan();
+}
+
+void ScanAssembler::resetScan()
+{
+  if (compact_scan_) {
+    compact_scan_msg_.reset(new pandar_msgs::PandarCompactScan);
+  }
+  else {
+    scan_.reset(new pandar_msgs::PandarScan);
+  }
+  packet_count_ = 0;
+  prev_phase_ = 0;
+  scan_sector_ = 0;
+  scan_lost_ = sequence_.lost();
+  scan_duplicated_ = sequence_.duplicated();
+  scan_reordered_ = sequence_.reordered();
+}
+
+bool ScanAssembler::addPacket(const pandar_msgs::PandarPacket& packet)
+{
+  const int sequence_index = sequence_index_(packet.size);
+  if (sequence_index >= 0) {
+    const auto& data = packet.data;
+    uint32_t sequence = (data[sequence_index] & 0xff) | ((data[sequence_index + 1] & 0xff) << 8) |
+                        ((data[sequence_index + 2] & 0xff) << 16) | ((data[sequence_index + 3] & 0xff) << 24);
+    if (sequence_.update(sequence) == SequenceTracker::Result::DUPLICATE) {
+      return false;
+    }
+  }
+
+  if (packet_count_++ == 0) {
+    scan_stamp_ = packet.stamp;
+  }
+  if (compact_scan_) {
+    compact_scan_msg_->stamps.push_back(packet.stamp);
+    compact_scan_msg_->offsets.push_back(static_cast<uint32_t>(compact_scan_msg_->data.size()));
+    compact_scan_msg_->data.insert(compact_scan_msg_->data.end(), packet.data.begin(),
+                                   packet.data.begin() + packet.size);
+  }
+  else {
+    scan_->packets.push_back(packet);
+  }
+
+  int current_phase = 0;
+  {
+    const auto& data = packet.data;
+    current_phase = (data[azimuth_index_] & 0xff) | ((data[azimuth_index_ + 1] & 0xff) << 8);
+    current_phase = (static_cast<int>(current_phase) + 36000 - scan_phase_) % 36000;
+  }
+  if (packet_count_ < 2) {
+    scan_sector_ = sector_width_ > 0 ? static_cast<uint16_t>(current_phase / sector_width_) : 0;
+    prev_phase_ = current_phase;
+    return false;
+  }
+  // like the wrap, the packet crossing into the next sector still belongs to this slice
+  const bool sector_done = sector_width_ > 0 && current_phase / sector_width_ != prev_phase_ / sector_width_;
+  if (current_phase >= prev_phase_ && !sector_done) {
+    prev_phase_ = current_phase;
+    return false;
+  }
+  // has scanned !
+  return true;
+}
+
+void ScanAssembler::publish()
+{
+  // a late packet can refill a gap of the previous scan, so lost may shrink
+  const uint32_t lost = sequence_.lost() > scan_lost_ ? static_cast<uint32_t>(sequence_.lost() - scan_lost_) : 0;
+  const uint32_t duplicated = static_cast<uint32_t>(sequence_.duplicated() - scan_duplicated_);
+  const uint32_t reordered = static_cast<uint32_t>(sequence_.reordered() - scan_reordered_);
+  if (compact_scan_) {
+    compact_scan_msg_->header.stamp = scan_stamp_;
+    compact_scan_msg_->header.frame_id = frame_id_;
+    compact_scan_msg_->packets_lost = lost;
+    compact_scan_msg_->packets_duplicated = duplicated;
+    compact_scan_msg_->packets_reordered = reordered;
+    compact_scan_msg_->sector_index = scan_sector_;
+    compact_scan_msg_->sector_count = sector_count_;
+    pandar_packet_pub_.publish(compact_scan_msg_);
+  }
+  else {
+    scan_->header.stamp = scan_stamp_;
+    scan_->header.frame_id = frame_id_;
+    scan_->packets_lost = lost;
+    scan_->packets_duplicated = duplicated;
+    scan_->packets_reordered = reordered;
+    scan_->sector_index = scan_sector_;
+    scan_->sector_count = sector_count_;
+    pandar_packet_pub_.publish(scan_);
+  }
+  resetScan();
+}
+
+void ScanAssembler::diagnose(diagnostic_updater::DiagnosticStatusWrapper& stat)
+{
+  const uint64_t received = sequence_.received() - diag_received_;
+  const uint64_t lost = sequence_.lost() > diag_lost_ ? sequence_.lost() - diag_lost_ : 0;
+  diag_received_ = sequence_.received();
+  diag_lost_ = sequence_.lost();
+
+  stat.add("received", sequence_.received());
+  stat.add("lost", sequence_.lost());
+  stat.add("duplicated", sequence_.duplicated());
+  stat.add("reordered", sequence_.reordered());
+  if (sequence_.received() == 0) {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "no udp_sequence in packets");
+  }
+  else if (lost > 0) {
+    stat.summaryf(diagnostic_msgs::DiagnosticStatus::WARN, "%lu of %lu packets lost", lost, received + lost);
+  }
+  else {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "OK");
+  }
+}
@@ -0,0 +1,222 @@
+#include "pandar_driver/packet_mmap_input.h"
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+using namespace pandar_driver;
+
+namespace
+{
+const size_t RING_BLOCK_SIZE = 1 << 20;  // 1 MiB, ~850 Pandar packets
+const size_t RING_BLOCK_COUNT = 16;
+const size_t RING_FRAME_SIZE = 2048;
+const unsigned int RING_BLOCK_TIMEOUT_MS = 2;  // retire partially filled blocks so latency stays low
+
+const size_t UDP_HEADER_SIZE = 8;
+}  // namespace
+
+PacketMmapInput::PacketMmapInput(const std::string& interface, const std::string& device_ip, uint16_t port,
+                                 int timeout)
+  : fd_(-1), timeout_(timeout), ring_(nullptr), ring_size_(0), block_size_(RING_BLOCK_SIZE),
+    block_count_(RING_BLOCK_COUNT), block_index_(0), block_(nullptr), next_packet_(nullptr), packets_left_(0),
+    kernel_drops_(0)
+{
+  in_addr device_addr{};
+  if (inet_pton(AF_INET, device_ip.c_str(), &device_addr) != 1) {
+    ROS_ERROR("packet_mmap: invalid device ip %s", device_ip.c_str());
+    return;
+  }
+  const unsigned int ifindex = if_nametoindex(interface.c_str());
+  if (ifindex == 0) {
+    ROS_ERROR("packet_mmap: unknown interface %s", interface.c_str());
+    return;
+  }
+
+  fd_ = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_IP));
+  if (fd_ < 0) {
+    ROS_ERROR("packet_mmap: socket failed: %s (CAP_NET_RAW is required)", strerror(errno));
+    return;
+  }
+
+  // the filter goes on before bind so no unrelated traffic reaches the ring
+  if (!attachFilter(device_addr.s_addr, port)) {
+    ROS_ERROR("packet_mmap: attaching the BPF filter failed: %s", strerror(errno));
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+
+  int version = TPACKET_V3;
+  if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0) {
+    ROS_ERROR("packet_mmap: TPACKET_V3 is not supported: %s", strerror(errno));
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+
+  tpacket_req3 req{};
+  req.tp_block_size = block_size_;
+  req.tp_block_nr = block_count_;
+  req.tp_frame_size = RING_FRAME_SIZE;
+  req.tp_frame_nr = (block_size_ * block_count_) / RING_FRAME_SIZE;
+  req.tp_retire_blk_tov = RING_BLOCK_TIMEOUT_MS;
+  if (setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0) {
+    ROS_ERROR("packet_mmap: PACKET_RX_RING failed: %s", strerror(errno));
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+
+  ring_size_ = block_size_ * block_count_;
+  void* ring = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd_, 0);
+  if (ring == MAP_FAILED) {
+    // MAP_LOCKED may exceed RLIMIT_MEMLOCK, the ring still works unlocked
+    ring = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  }
+  if (ring == MAP_FAILED) {
+    ROS_ERROR("packet_mmap: mmap of the rx ring failed: %s", strerror(errno));
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+  ring_ = static_cast<uint8_t*>(ring);
+
+  sockaddr_ll addr{};
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_IP);
+  addr.sll_ifindex = static_cast<int>(ifindex);
+  if (bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    ROS_ERROR("packet_mmap: bind to %s failed: %s", interface.c_str(), strerror(errno));
+    munmap(ring_, ring_size_);
+    ring_ = nullptr;
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+}
+
+PacketMmapInput::~PacketMmapInput()
+{
+  if (ring_) {
+    munmap(ring_, ring_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool PacketMmapInput::attachFilter(uint32_t device_addr, uint16_t port)
+{
+  // ether[12:2] == IPv4 && ip proto == UDP && !fragment && ip src == device && udp dst port == port
+  sock_filter code[] = {
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 10),
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 8),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 26),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(device_addr), 0, 6),
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+    BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),
+    BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 1),
+    BPF_STMT(BPF_RET | BPF_K, 0xffff),
+    BPF_STMT(BPF_RET | BPF_K, 0),
+  };
+  sock_fprog program{};
+  program.len = sizeof(code) / sizeof(code[0]);
+  program.filter = code;
+  return setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) == 0;
+}
+
+bool PacketMmapInput::nextBlock(bool wait)
+{
+  auto* desc = reinterpret_cast<tpacket_block_desc*>(ring_ + block_index_ * block_size_);
+  if ((__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+    if (!wait) {
+      return false;
+    }
+    pollfd pfd{ fd_, POLLIN | POLLERR, 0 };
+    if (::poll(&pfd, 1, timeout_) <= 0) {
+      return false;
+    }
+    if ((__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+      return false;
+    }
+  }
+  block_ = reinterpret_cast<uint8_t*>(desc);
+  packets_left_ = desc->hdr.bh1.num_pkts;
+  next_packet_ = reinterpret_cast<tpacket3_hdr*>(block_ + desc->hdr.bh1.offset_to_first_pkt);
+  return true;
+}
+
+void PacketMmapInput::releaseBlock()
+{
+  auto* desc = reinterpret_cast<tpacket_block_desc*>(block_);
+  __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+  block_ = nullptr;
+  next_packet_ = nullptr;
+  block_index_ = (block_index_ + 1) % block_count_;
+}
+
+uint64_t PacketMmapInput::kernelDrops()
+{
+  tpacket_stats_v3 stats{};
+  socklen_t len = sizeof(stats);
+  if (fd_ >= 0 && getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0) {
+    kernel_drops_ += stats.tp_drops;
+  }
+  return kernel_drops_;
+}
+
+PacketMmapInput::PacketType PacketMmapInput::getPacket(pandar_msgs::PandarPacket* pkt)
+{
+  return getPackets(pkt, 1) == 1 ? PacketType::LIDAR : PacketType::ERROR;
+}
+
+size_t PacketMmapInput::getPackets(pandar_msgs::PandarPacket* packets, size_t max_packets)
+{
+  if (ring_ == nullptr) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeout_));
+    return 0;
+  }
+
+  size_t count = 0;
+  while (count < max_packets) {
+    // only block in poll() while nothing has been collected yet
+    if (block_ == nullptr && !nextBlock(count == 0)) {
+      break;
+    }
+
+    while (packets_left_ > 0 && count < max_packets) {
+      tpacket3_hdr* hdr = next_packet_;
+      const uint8_t* frame = reinterpret_cast<const uint8_t*>(hdr);
+      const uint8_t* ip = frame + hdr->tp_net;
+      const size_t ip_header_size = (ip[0] & 0x0f) * 4;
+      const uint8_t* payload = ip + ip_header_size + UDP_HEADER_SIZE;
+      const size_t captured = frame + hdr->tp_mac + hdr->tp_snaplen - payload;
+      const size_t udp_size = ((ip[ip_header_size + 4] << 8) | ip[ip_header_size + 5]) - UDP_HEADER_SIZE;
+
+      auto& pkt = packets[count++];
+      pkt.size = static_cast<uint32_t>(std::min({ captured, udp_size, pkt.data.size() }));
+      std::memcpy(pkt.data.data(), payload, pkt.size);
+      pkt.stamp = ros::Time(hdr->tp_sec, hdr->tp_nsec);
+
+      next_packet_ = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(hdr) + hdr->tp_next_offset);
+      --packets_left_;
+    }
+    if (packets_left_ == 0) {
+      releaseBlock();
+    }
+  }
+  return count;
+}
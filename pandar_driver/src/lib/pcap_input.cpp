@@ -1,21 +1,94 @@
-#include <sys/time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
-#include <map>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
+#include <map>
+#include <thread>
 #include "pandar_driver/pcap_input.h"
 
 using namespace pandar_driver;
 
 namespace
 {
-const uint8_t PKT_HEADER_SIZE = 42;
-const size_t LIMIT_PACKET_NUM = 100;
+// resynchronise the replay clock when the capture time jumps by more than this (loops, clock steps)
+const int64_t MAX_PACKET_GAP_US = 1000000;
+
+const size_t PCAP_FILE_HEADER_SIZE = 24;
+const size_t PCAP_RECORD_HEADER_SIZE = 16;
+const uint32_t PCAP_MAGIC_USEC = 0xa1b2c3d4;
+const uint32_t PCAP_MAGIC_NSEC = 0xa1b23c4d;
+const uint32_t LINKTYPE_NULL = 0;
+const uint32_t LINKTYPE_ETHERNET = 1;
+const uint32_t LINKTYPE_RAW = 101;
+const uint32_t LINKTYPE_LINUX_SLL = 113;
+const uint32_t LINKTYPE_LINUX_SLL2 = 276;
+
+const char INDEX_MAGIC[8] = { 'P', 'A', 'N', 'D', 'A', 'I', 'D', 'X' };
+const uint32_t INDEX_VERSION = 1;
+
+struct IndexHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t port;
+  uint64_t file_size;
+  int64_t file_mtime;
+  uint64_t packet_num;
+};
+
+uint16_t readBE16(const uint8_t* p)
+{
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t readU32(const uint8_t* p, bool swapped)
+{
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return swapped ? __builtin_bswap32(v) : v;
+}
+
+// Offset of the IPv4 header inside a captured frame, or -1 for anything that is not IPv4.
+int ipOffset(uint32_t link_type, const uint8_t* frame, size_t size)
+{
+  switch (link_type) {
+    case LINKTYPE_ETHERNET: {
+      if (size < 14) {
+        return -1;
+      }
+      size_t offset = 12;
+      uint16_t ether_type = readBE16(frame + offset);
+      while ((ether_type == 0x8100 || ether_type == 0x88a8) && offset + 6 <= size) {  // VLAN tags
+        offset += 4;
+        ether_type = readBE16(frame + offset);
+      }
+      return ether_type == 0x0800 ? static_cast<int>(offset + 2) : -1;
+    }
+    case LINKTYPE_LINUX_SLL:
+      return size >= 16 && readBE16(frame + 14) == 0x0800 ? 16 : -1;
+    case LINKTYPE_LINUX_SLL2:
+      return size >= 20 && readBE16(frame) == 0x0800 ? 20 : -1;
+    case LINKTYPE_NULL:
+      return size >= 4 ? 4 : -1;
+    case LINKTYPE_RAW:
+      return 0;
+    default:
+      return -1;
+  }
+}
 }  // namespace
 
-PcapInput::PcapInput(uint16_t port, uint16_t gps_port, std::string path, std::string model)
-  : pcap_(nullptr), last_pkt_ts_(0)
+PcapInput::PcapInput(uint16_t port, uint16_t gps_port, std::string path, std::string model, double replay_rate)
+  : port_(port), replay_rate_(replay_rate), fd_(-1), file_(nullptr), file_size_(0), file_mtime_(0), next_index_(0),
+    cached_utc_{}, cached_utc_sec_(0), replay_started_(false), first_sensor_us_(0), last_sensor_us_(0),
+    anchor_sensor_us_(0), replayed_packets_(0), replayed_bytes_(0), end_reported_(false)
 {
   initTimeIndexMap();
   pcap_path_ = path;
@@ -34,33 +107,144 @@ PcapInput::PcapInput(uint16_t port, uint16_t gps_port, std::string path, std::st
     return;
   }
 
-  pcap_ = pcap_open_offline(pcap_path_.c_str(), errbuf_);
-
-  if (pcap_ == nullptr) {
+  if (!mapFile()) {
     printf("open pcap file %s fail\n", pcap_path_.c_str());
     return;
   }
 
-  std::stringstream filter;
-  filter << "udp dst port " << port;
-  if (pcap_compile(pcap_, &pcap_filter_, filter.str().c_str(), 1, PCAP_NETMASK_UNKNOWN) == -1) {
-    printf("compile pcap file fail\n");
-    return;
+  const std::string index_path = pcap_path_ + ".idx";
+  if (!loadIndex(index_path)) {
+    buildIndex();
+    saveIndex(index_path);
   }
+}
 
-  if (pcap_setfilter(pcap_, &pcap_filter_) == -1) {
-    printf("pcap set filter fail\n");
+PcapInput::~PcapInput()
+{
+  if (file_) {
+    munmap(const_cast<uint8_t*>(file_), file_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool PcapInput::mapFile()
+{
+  fd_ = open(pcap_path_.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd_, &st) != 0 || st.st_size < static_cast<off_t>(PCAP_FILE_HEADER_SIZE)) {
+    return false;
+  }
+  file_size_ = static_cast<size_t>(st.st_size);
+  file_mtime_ = static_cast<int64_t>(st.st_mtime);
+
+  void* file = mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (file == MAP_FAILED) {
+    return false;
+  }
+  file_ = static_cast<const uint8_t*>(file);
+  madvise(file, file_size_, MADV_SEQUENTIAL);
+  return true;
+}
+
+bool PcapInput::loadIndex(const std::string& index_path)
+{
+  std::ifstream in(index_path, std::ios::binary);
+  IndexHeader header;
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    return false;
+  }
+  if (std::memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header.version != INDEX_VERSION ||
+      header.port != port_ || header.file_size != file_size_ || header.file_mtime != file_mtime_) {
+    return false;
+  }
+  std::vector<IndexEntry> index(header.packet_num);
+  if (!in.read(reinterpret_cast<char*>(index.data()), index.size() * sizeof(IndexEntry))) {
+    return false;
+  }
+  for (const auto& entry : index) {
+    if (entry.offset + entry.size > file_size_) {
+      return false;
+    }
+  }
+  index_.swap(index);
+  return true;
+}
+
+void PcapInput::buildIndex()
+{
+  const uint32_t magic = readU32(file_, false);
+  const bool swapped = magic == __builtin_bswap32(PCAP_MAGIC_USEC) || magic == __builtin_bswap32(PCAP_MAGIC_NSEC);
+  if (!swapped && magic != PCAP_MAGIC_USEC && magic != PCAP_MAGIC_NSEC) {
+    printf("%s is not a pcap file (pcapng is not supported)\n", pcap_path_.c_str());
     return;
   }
+  const uint32_t link_type = readU32(file_ + 20, swapped) & 0x0fffffff;
+
+  index_.clear();
+  size_t offset = PCAP_FILE_HEADER_SIZE;
+  while (offset + PCAP_RECORD_HEADER_SIZE <= file_size_) {
+    const size_t captured = readU32(file_ + offset + 8, swapped);
+    const uint8_t* frame = file_ + offset + PCAP_RECORD_HEADER_SIZE;
+    offset += PCAP_RECORD_HEADER_SIZE + captured;
+    if (offset > file_size_) {
+      break;  // truncated capture
+    }
+
+    int ip_offset = ipOffset(link_type, frame, captured);
+    if (ip_offset < 0 || static_cast<size_t>(ip_offset) + 20 > captured) {
+      continue;
+    }
+    const uint8_t* ip = frame + ip_offset;
+    const size_t ip_header_size = (ip[0] & 0x0f) * 4;
+    // IPv4, UDP, not fragmented
+    if ((ip[0] >> 4) != 4 || ip[9] != 17 || (readBE16(ip + 6) & 0x3fff) != 0 ||
+        ip_offset + ip_header_size + 8 > captured) {
+      continue;
+    }
+    const uint8_t* udp = ip + ip_header_size;
+    if (readBE16(udp + 2) != port_) {
+      continue;
+    }
+    const uint8_t* payload = udp + 8;
+    const size_t available = frame + captured - payload;
+    const size_t udp_size = readBE16(udp + 4) >= 8 ? readBE16(udp + 4) - 8 : 0;
+    index_.push_back({ static_cast<uint64_t>(payload - file_), static_cast<uint32_t>(std::min(available, udp_size)) });
+  }
 }
 
-PcapInput::~PcapInput()
+void PcapInput::saveIndex(const std::string& index_path) const
 {
-  pcap_close(pcap_);
+  IndexHeader header;
+  std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  header.version = INDEX_VERSION;
+  header.port = port_;
+  header.file_size = file_size_;
+  header.file_mtime = file_mtime_;
+  header.packet_num = index_.size();
+
+  // written beside the capture and renamed into place; a read-only directory just means no cache
+  const std::string tmp_path = index_path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out.write(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+        !out.write(reinterpret_cast<const char*>(index_.data()), index_.size() * sizeof(IndexEntry))) {
+      std::remove(tmp_path.c_str());
+      return;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), index_path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+  }
 }
 
 void PcapInput::initTimeIndexMap()
 {
+  // {timestamp, utc} offsets in the packet tail, negative offsets count from the end of the packet
   time_index_map_.insert(std::pair<std::string, std::pair<int, int>>("Pandar40P", std::pair<int, int>(1250, 1256)));
   time_index_map_.insert(std::pair<std::string, std::pair<int, int>>("Pandar40M", std::pair<int, int>(1250, 1256)));
   time_index_map_.insert(std::pair<std::string, std::pair<int, int>>("Pandar64", std::pair<int, int>(1182, 1188)));
@@ -69,74 +253,128 @@ void PcapInput::initTimeIndexMap()
   time_index_map_.insert(std::pair<std::string, std::pair<int, int>>("Pandar20B", std::pair<int, int>(1258, 1264)));
   time_index_map_.insert(std::pair<std::string, std::pair<int, int>>("PandarXT-32", std::pair<int, int>(1071, 1065)));
   time_index_map_.insert(std::pair<std::string, std::pair<int, int>>("PandarXT-16", std::pair<int, int>(559, 553)));
+  time_index_map_.insert(std::pair<std::string, std::pair<int, int>>("PandarXTM", std::pair<int, int>(811, 805)));
+  time_index_map_.insert(std::pair<std::string, std::pair<int, int>>("PandarQT128", std::pair<int, int>(1082, 1076)));
+  // 1117 or 861 bytes depending on the packet format
+  time_index_map_.insert(std::pair<std::string, std::pair<int, int>>("Pandar128E4X", std::pair<int, int>(-35, -41)));
+}
+
+bool PcapInput::nextView(PacketView* view)
+{
+  if (next_index_ >= index_.size()) {
+    reportReplay();
+    return false;
+  }
+  const IndexEntry& entry = index_[next_index_++];
+  view->data = file_ + entry.offset;
+  view->size = entry.size;
+  return true;
 }
 
 PcapInput::PacketType PcapInput::getPacket(pandar_msgs::PandarPacket* pandar_pkt)
 {
-  pcap_pkthdr* pkt_header;
-  const uint8_t* pkt_data;
-  int64_t current_time;
-  int64_t pkt_ts = 0;
+  return getPackets(pandar_pkt, 1) == 1 ? PacketType::LIDAR : PacketType::ERROR;
+}
 
-  while (true) {
-    if (pcap_next_ex(pcap_, &pkt_header, &pkt_data) >= 0) {
-      if (pcap_offline_filter(&pcap_filter_, pkt_header, pkt_data) == 0) {
-        continue;
-      }
-      const uint8_t* packet = pkt_data + PKT_HEADER_SIZE;
-      int pkt_size = pkt_header->len - PKT_HEADER_SIZE;
-      pandar_pkt->stamp = ros::Time::now();
-      pandar_pkt->size = pkt_size;
-      std::memcpy(&pandar_pkt->data[0], packet, pkt_size);
-
-      packet_count_++;
-      // Sleep
-      if (packet_count_ >= LIMIT_PACKET_NUM && utc_index_ != 0) {
-        packet_count_ = 0;
-
-        struct tm t;
-        t.tm_year = packet[utc_index_];
-        t.tm_mon = packet[utc_index_ + 1] - 1;
-        t.tm_mday = packet[utc_index_ + 2];
-        t.tm_hour = packet[utc_index_ + 3];
-        t.tm_min = packet[utc_index_ + 4];
-        t.tm_sec = packet[utc_index_ + 5];
-        t.tm_isdst = 0;
-
-        pkt_ts =
-            mktime(&t) * 1000000 + ((packet[ts_index_] & 0xff) | (packet[ts_index_ + 1] & 0xff) << 8 |
-                                    ((packet[ts_index_ + 2] & 0xff) << 16) | ((packet[ts_index_ + 3] & 0xff) << 24));
-        struct timeval sys_time;
-        gettimeofday(&sys_time, nullptr);
-        current_time = sys_time.tv_sec * 1000000 + sys_time.tv_usec;
-
-        if (0 == last_pkt_ts_) {
-          last_pkt_ts_ = pkt_ts;
-          last_time_ = current_time;
-        }
-        else {
-          int64_t sleep_time = (pkt_ts - last_pkt_ts_) - (current_time - last_time_);
-          if (sleep_time > 0) {
-            struct timeval waitTime;
-            waitTime.tv_sec = sleep_time / 1000000;
-            waitTime.tv_usec = sleep_time % 1000000;
-
-            int err;
-
-            do {
-              err = select(0, nullptr, nullptr, nullptr, &waitTime);
-            } while (err < 0 && errno != EINTR);
-          }
-
-          last_pkt_ts_ = pkt_ts;
-          last_time_ = current_time;
-          last_time_ += sleep_time;
-        }
-      }
-      return PacketType::LIDAR;
-    }
-    else {
-      return PacketType::ERROR;
+size_t PcapInput::getPackets(pandar_msgs::PandarPacket* packets, size_t max_packets)
+{
+  size_t count = 0;
+  PacketView view;
+  while (count < max_packets && nextView(&view)) {
+    auto& pandar_pkt = packets[count++];
+    pandar_pkt.size = std::min<uint32_t>(view.size, pandar_pkt.data.size());
+    std::memcpy(pandar_pkt.data.data(), view.data, pandar_pkt.size);
+    throttle(view.data, view.size);
+    pandar_pkt.stamp = ros::Time::now();
+  }
+  return count;
+}
+
+bool PcapInput::sensorTime(const uint8_t* packet, uint32_t size, int64_t* usec)
+{
+  if (utc_index_ == 0) {
+    return false;
+  }
+  const int64_t ts_index = ts_index_ < 0 ? static_cast<int64_t>(size) + ts_index_ : ts_index_;
+  const int64_t utc_index = utc_index_ < 0 ? static_cast<int64_t>(size) + utc_index_ : utc_index_;
+  if (ts_index < 0 || utc_index < 0 || ts_index + 4 > size || utc_index + 6 > size) {
+    return false;
+  }
+
+  // the utc field only changes once per second, so timegm runs once per second of capture
+  const uint8_t* utc = packet + utc_index;
+  if (std::memcmp(utc, cached_utc_, sizeof(cached_utc_)) != 0) {
+    struct tm t = {};
+    t.tm_year = utc[0] + 100;
+    if (t.tm_year >= 200) {
+      t.tm_year -= 100;
     }
+    t.tm_mon = utc[1] - 1;
+    t.tm_mday = utc[2];
+    t.tm_hour = utc[3];
+    t.tm_min = utc[4];
+    t.tm_sec = utc[5];
+    cached_utc_sec_ = timegm(&t);
+    std::memcpy(cached_utc_, utc, sizeof(cached_utc_));
+  }
+
+  const uint8_t* ts = packet + ts_index;
+  const uint32_t us = (ts[0] & 0xff) | (ts[1] & 0xff) << 8 | ((ts[2] & 0xff) << 16) | ((ts[3] & 0xff) << 24);
+  *usec = cached_utc_sec_ * 1000000 + us % 1000000;
+  return true;
+}
+
+void PcapInput::throttle(const uint8_t* packet, uint32_t size)
+{
+  const auto now = std::chrono::steady_clock::now();
+  if (!replay_started_) {
+    replay_started_ = true;
+    replay_start_ = now;
+    anchor_time_ = now;
+  }
+  replayed_packets_++;
+  replayed_bytes_ += size;
+
+  int64_t sensor_us;
+  if (!sensorTime(packet, size, &sensor_us)) {
+    return;
+  }
+  if (first_sensor_us_ == 0) {
+    first_sensor_us_ = sensor_us;
+    anchor_sensor_us_ = sensor_us;
+  }
+  else if (sensor_us < last_sensor_us_ || sensor_us - last_sensor_us_ > MAX_PACKET_GAP_US) {
+    anchor_sensor_us_ = sensor_us;
+    anchor_time_ = now;
+  }
+  last_sensor_us_ = sensor_us;
+
+  if (replay_rate_ <= 0.0) {
+    return;
+  }
+  // packets are released on a schedule anchored at the first packet, so sleep errors do not accumulate
+  const auto target =
+      anchor_time_ + std::chrono::microseconds(static_cast<int64_t>((sensor_us - anchor_sensor_us_) / replay_rate_));
+  if (target > now) {
+    std::this_thread::sleep_until(target);
+  }
+}
+
+void PcapInput::reportReplay()
+{
+  if (end_reported_ || !replay_started_) {
+    return;
+  }
+  end_reported_ = true;
+
+  const double elapsed =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - replay_start_).count();
+  const double sensor_span = (last_sensor_us_ - first_sensor_us_) * 1e-6;
+  ROS_INFO("pcap replay of %s finished: %zu packets, %.1f MB in %.2f s (%.0f packets/s, %.1f MB/s)",
+           pcap_path_.c_str(), replayed_packets_, replayed_bytes_ * 1e-6, elapsed,
+           elapsed > 0.0 ? replayed_packets_ / elapsed : 0.0, elapsed > 0.0 ? replayed_bytes_ * 1e-6 / elapsed : 0.0);
+  if (sensor_span > 0.0 && elapsed > 0.0) {
+    ROS_INFO("pcap replay covered %.2f s of sensor time, achieved rate %.2fx (requested %s)", sensor_span,
+             sensor_span / elapsed, replay_rate_ > 0.0 ? std::to_string(replay_rate_).c_str() : "unthrottled");
   }
 }
@@ -0,0 +1,190 @@
+#include "pandar_driver/pcap_writer.h"
+#include <arpa/inet.h>
+#include <time.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+using namespace pandar_driver;
+
+namespace
+{
+const auto EMPTY_QUEUE_BACKOFF = std::chrono::milliseconds(1);
+const size_t FILE_BUFFER_SIZE = 1 << 20;
+
+const uint32_t PCAP_MAGIC_NSEC = 0xa1b23c4d;
+const uint32_t LINKTYPE_ETHERNET = 1;
+const size_t ETHERNET_HEADER_SIZE = 14;
+const size_t IP_HEADER_SIZE = 20;
+const size_t UDP_HEADER_SIZE = 8;
+const size_t FRAME_HEADER_SIZE = ETHERNET_HEADER_SIZE + IP_HEADER_SIZE + UDP_HEADER_SIZE;  // 42
+
+struct PcapFileHeader
+{
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+};
+
+struct PcapRecordHeader
+{
+  uint32_t ts_sec;
+  uint32_t ts_nsec;
+  uint32_t incl_len;
+  uint32_t orig_len;
+};
+
+void putBE16(uint8_t* p, uint16_t v)
+{
+  p[0] = static_cast<uint8_t>(v >> 8);
+  p[1] = static_cast<uint8_t>(v);
+}
+
+void putBE32(uint8_t* p, uint32_t v)
+{
+  putBE16(p, static_cast<uint16_t>(v >> 16));
+  putBE16(p + 2, static_cast<uint16_t>(v));
+}
+}  // namespace
+
+PcapWriter::PcapWriter(const std::string& prefix, const std::string& device_ip, uint16_t port, size_t queue_capacity,
+                       size_t rotate_bytes)
+  : prefix_(prefix), device_addr_(0), port_(port), rotate_bytes_(rotate_bytes), queue_(queue_capacity),
+    written_(0), file_(nullptr), file_index_(0), file_bytes_(0), file_buffer_(FILE_BUFFER_SIZE), running_(true)
+{
+  in_addr addr{};
+  if (inet_pton(AF_INET, device_ip.c_str(), &addr) == 1) {
+    device_addr_ = ntohl(addr.s_addr);
+  }
+  writer_thread_ = std::thread(&PcapWriter::writeLoop, this);
+}
+
+PcapWriter::~PcapWriter()
+{
+  running_ = false;
+  if (writer_thread_.joinable()) {
+    writer_thread_.join();
+  }
+  ROS_INFO("pcap recorder: %lu packets written, %lu dropped", written(), dropped());
+}
+
+void PcapWriter::write(const pandar_msgs::PandarPacket* packets, size_t count)
+{
+  while (count > 0) {
+    pandar_msgs::PandarPacket* slots;
+    const size_t free_slots = queue_.writable(&slots);
+    if (free_slots == 0) {
+      queue_.addOverruns(count);
+      return;
+    }
+    const size_t n = std::min(free_slots, count);
+    for (size_t i = 0; i < n; ++i) {
+      slots[i].stamp = packets[i].stamp;
+      slots[i].size = packets[i].size;
+      std::memcpy(slots[i].data.data(), packets[i].data.data(), packets[i].size);
+    }
+    queue_.push(n);
+    packets += n;
+    count -= n;
+  }
+}
+
+void PcapWriter::writeLoop()
+{
+  while (true) {
+    const pandar_msgs::PandarPacket* slots;
+    const size_t count = queue_.readable(&slots);
+    if (count == 0) {
+      if (!running_) {
+        break;
+      }
+      std::this_thread::sleep_for(EMPTY_QUEUE_BACKOFF);
+      continue;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      writeRecord(slots[i]);
+    }
+    queue_.pop(count);
+  }
+  closeFile();
+}
+
+bool PcapWriter::openFile()
+{
+  char stamp[32];
+  time_t now = time(nullptr);
+  struct tm t;
+  localtime_r(&now, &t);
+  strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &t);
+  // the index keeps names unique when files rotate within a second
+  const std::string path = prefix_ + "_" + stamp + "_" + std::to_string(file_index_++) + ".pcap";
+
+  file_ = fopen(path.c_str(), "wb");
+  if (file_ == nullptr) {
+    ROS_ERROR_THROTTLE(5.0, "pcap recorder: cannot open %s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  setvbuf(file_, file_buffer_.data(), _IOFBF, file_buffer_.size());
+
+  PcapFileHeader header{ PCAP_MAGIC_NSEC, 2, 4, 0, 0, 65535, LINKTYPE_ETHERNET };
+  fwrite(&header, sizeof(header), 1, file_);
+  file_bytes_ = sizeof(header);
+  ROS_INFO("pcap recorder: writing %s", path.c_str());
+  return true;
+}
+
+void PcapWriter::closeFile()
+{
+  if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+void PcapWriter::writeRecord(const pandar_msgs::PandarPacket& packet)
+{
+  if (file_ && rotate_bytes_ > 0 && file_bytes_ >= rotate_bytes_) {
+    closeFile();
+  }
+  if (file_ == nullptr && !openFile()) {
+    return;
+  }
+
+  uint8_t frame[FRAME_HEADER_SIZE] = {};
+  // ethernet: zero addresses, IPv4
+  putBE16(frame + 12, 0x0800);
+  // IPv4 from the device to the broadcast address, don't fragment
+  uint8_t* ip = frame + ETHERNET_HEADER_SIZE;
+  ip[0] = 0x45;
+  putBE16(ip + 2, static_cast<uint16_t>(IP_HEADER_SIZE + UDP_HEADER_SIZE + packet.size));
+  putBE16(ip + 6, 0x4000);
+  ip[8] = 64;
+  ip[9] = 17;
+  putBE32(ip + 12, device_addr_);
+  putBE32(ip + 16, 0xffffffff);
+  uint32_t sum = 0;
+  for (size_t i = 0; i < IP_HEADER_SIZE; i += 2) {
+    sum += (ip[i] << 8) | ip[i + 1];
+  }
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  putBE16(ip + 10, static_cast<uint16_t>(~sum));
+  // UDP, no checksum
+  uint8_t* udp = ip + IP_HEADER_SIZE;
+  putBE16(udp, port_);
+  putBE16(udp + 2, port_);
+  putBE16(udp + 4, static_cast<uint16_t>(UDP_HEADER_SIZE + packet.size));
+
+  const uint32_t frame_size = static_cast<uint32_t>(FRAME_HEADER_SIZE + packet.size);
+  PcapRecordHeader record{ packet.stamp.sec, packet.stamp.nsec, frame_size, frame_size };
+  fwrite(&record, sizeof(record), 1, file_);
+  fwrite(frame, FRAME_HEADER_SIZE, 1, file_);
+  fwrite(packet.data.data(), packet.size, 1, file_);
+  file_bytes_ += sizeof(record) + frame_size;
+  written_.fetch_add(1, std::memory_order_relaxed);
+}
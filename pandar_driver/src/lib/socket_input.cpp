@@ -1,14 +1,38 @@
 #include "pandar_driver/socket_input.h"
+#include <poll.h>
+#include <cstring>
 
 using namespace pandar_driver;
 
 namespace
 {
 const size_t ETHERNET_MTU = 1500;
+
+const timespec* kernelTimestamp(msghdr& msg)
+{
+  for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      return reinterpret_cast<const timespec*>(CMSG_DATA(cmsg));
+    }
+  }
+  return nullptr;
+}
+
+bool overflowCount(msghdr& msg, uint32_t* count)
+{
+  for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+      std::memcpy(count, CMSG_DATA(cmsg), sizeof(*count));
+      return true;
+    }
+  }
+  return false;
 }
+}  // namespace
 
-SocketInput::SocketInput(const std::string& device_ip, uint16_t port, uint16_t gps_port, int timeout)
-  : io_service_()
+SocketInput::SocketInput(const std::string& device_ip, uint16_t port, uint16_t gps_port, int timeout,
+                         bool kernel_timestamp)
+  : io_service_(), kernel_timestamp_(kernel_timestamp), kernel_drops_(0)
 {
   device_ip_ = boost::asio::ip::address::from_string(device_ip);
   timeout_ = timeout;
@@ -16,6 +40,19 @@ SocketInput::SocketInput(const std::string& device_ip, uint16_t port, uint16_t g
   lidar_socket_ = std::make_unique<udp::socket>(io_service_, udp::endpoint(udp::v4(), port));
   gps_socket_ = std::make_unique<udp::socket>(io_service_, udp::endpoint(udp::v4(), gps_port));
   deadline_ = std::make_unique<boost::asio::deadline_timer>(io_service_);
+
+  if (kernel_timestamp_) {
+    int enable = 1;
+    if (setsockopt(lidar_socket_->native_handle(), SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) != 0) {
+      ROS_WARN("SO_TIMESTAMPNS is not supported, falling back to ros::Time::now() stamps");
+      kernel_timestamp_ = false;
+    }
+  }
+
+  // the kernel then attaches its drop counter to every datagram read with recvmmsg
+  int enable = 1;
+  setsockopt(lidar_socket_->native_handle(), SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+
   deadline_->expires_at(boost::posix_time::pos_infin);
   checkDeadline();
 }
@@ -27,6 +64,11 @@ SocketInput::~SocketInput(void)
 
 SocketInput::PacketType SocketInput::getPacket(pandar_msgs::PandarPacket* pkt)
 {
+  if (kernel_timestamp_) {
+    // the arrival time is only available from the control messages of recvmsg
+    return getPackets(pkt, 1) == 1 ? PacketType::LIDAR : PacketType::ERROR;
+  }
+
   deadline_->expires_from_now(boost::posix_time::milliseconds(timeout_));
 
   boost::system::error_code error_code = boost::asio::error::would_block;
@@ -49,6 +91,83 @@ SocketInput::PacketType SocketInput::getPacket(pandar_msgs::PandarPacket* pkt)
   }
 }
 
+size_t SocketInput::getPackets(pandar_msgs::PandarPacket* packets, size_t max_packets)
+{
+  const size_t batch_size = max_packets;
+  if (batch_size == 0) {
+    return 0;
+  }
+  if (msgs_.size() < batch_size) {
+    msgs_.resize(batch_size);
+    iovecs_.resize(batch_size);
+    addrs_.resize(batch_size);
+    controls_.resize(batch_size);
+  }
+
+  for (size_t i = 0; i < batch_size; ++i) {
+    iovecs_[i].iov_base = packets[i].data.data();
+    iovecs_[i].iov_len = ETHERNET_MTU;
+    msgs_[i].msg_hdr = {};
+    msgs_[i].msg_hdr.msg_name = &addrs_[i];
+    msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    msgs_[i].msg_hdr.msg_iov = &iovecs_[i];
+    msgs_[i].msg_hdr.msg_iovlen = 1;
+    msgs_[i].msg_hdr.msg_control = controls_[i].data();
+    msgs_[i].msg_hdr.msg_controllen = controls_[i].size();
+    msgs_[i].msg_len = 0;
+  }
+
+  // Wait for the first datagram, then drain whatever the kernel has queued without blocking again.
+  const int fd = lidar_socket_->native_handle();
+  pollfd pfd{ fd, POLLIN, 0 };
+  if (::poll(&pfd, 1, timeout_) <= 0) {
+    return 0;
+  }
+  int received = recvmmsg(fd, msgs_.data(), static_cast<unsigned int>(batch_size), MSG_DONTWAIT, nullptr);
+  if (received <= 0) {
+    return 0;
+  }
+
+  ros::Time batch_stamp;
+  if (!kernel_timestamp_) {
+    batch_stamp = ros::Time::now();
+  }
+  const in_addr_t device_addr = htonl(static_cast<uint32_t>(device_ip_.to_v4().to_ulong()));
+  size_t count = 0;
+  uint32_t drops;
+  if (overflowCount(msgs_[received - 1].msg_hdr, &drops)) {
+    kernel_drops_.store(drops, std::memory_order_relaxed);
+  }
+  for (size_t i = 0; i < static_cast<size_t>(received); ++i) {
+    if (addrs_[i].sin_addr.s_addr != device_addr) {
+      continue;
+    }
+    auto& pkt = packets[count];
+    if (count != i) {
+      // compact packets from other sources out of the slab (rare)
+      std::memcpy(pkt.data.data(), packets[i].data.data(), msgs_[i].msg_len);
+    }
+    if (kernel_timestamp_) {
+      const timespec* arrival = kernelTimestamp(msgs_[i].msg_hdr);
+      if (arrival) {
+        pkt.stamp = ros::Time(arrival->tv_sec, arrival->tv_nsec);
+      }
+      else {
+        if (batch_stamp.isZero()) {
+          batch_stamp = ros::Time::now();
+        }
+        pkt.stamp = batch_stamp;
+      }
+    }
+    else {
+      pkt.stamp = batch_stamp;
+    }
+    pkt.size = msgs_[i].msg_len;
+    ++count;
+  }
+  return count;
+}
+
 void SocketInput::checkDeadline()
 {
   if (deadline_->expires_at() <= boost::asio::deadline_timer::traits_type::now())
@@ -57,4 +176,4 @@ void SocketInput::checkDeadline()
     deadline_->expires_at(boost::posix_time::pos_infin);
   }
   deadline_->async_wait(std::bind(&SocketInput::checkDeadline, this));
-}
\ No newline at end of file
+}
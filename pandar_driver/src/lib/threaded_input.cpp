@@ -0,0 +1,108 @@
+#include "pandar_driver/threaded_input.h"
+#include <pthread.h>
+#include <chrono>
+#include <cstring>
+
+using namespace pandar_driver;
+
+ThreadedInput::ThreadedInput(std::shared_ptr<Input> input, size_t capacity, size_t batch_size, int cpu, int timeout)
+  : input_(input), ring_(capacity), batch_size_(std::max<size_t>(batch_size, 1)), timeout_(timeout), waiting_(false),
+    running_(true)
+{
+  overrun_slab_.resize(batch_size_);
+  receive_thread_ = std::thread(&ThreadedInput::receiveLoop, this);
+
+  if (cpu >= 0) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    if (pthread_setaffinity_np(receive_thread_.native_handle(), sizeof(cpu_set_t), &cpuset) != 0) {
+      ROS_WARN("Failed to pin receive thread to cpu %d", cpu);
+    }
+  }
+}
+
+ThreadedInput::~ThreadedInput()
+{
+  running_ = false;
+  if (receive_thread_.joinable()) {
+    receive_thread_.join();
+  }
+}
+
+void ThreadedInput::receiveLoop()
+{
+  while (running_) {
+    pandar_msgs::PandarPacket* slots;
+    size_t free_slots = ring_.writable(&slots);
+    if (free_slots == 0) {
+      // keep draining the socket so the loss shows up here rather than in the kernel buffer
+      ring_.addOverruns(input_->getPackets(overrun_slab_.data(), overrun_slab_.size()));
+      continue;
+    }
+    const size_t count = input_->getPackets(slots, std::min(free_slots, batch_size_));
+    if (count > 0) {
+      ring_.push(count);
+      wakeConsumer();
+    }
+  }
+}
+
+void ThreadedInput::wakeConsumer()
+{
+  // pairs with the fence in acquire(): either the consumer sees the new head or we see it waiting
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting_.load(std::memory_order_relaxed)) {
+    // under the lock the consumer is either inside wait() or has yet to check the ring
+    std::lock_guard<std::mutex> lock(mutex_);
+    not_empty_.notify_one();
+  }
+}
+
+Input::PacketType ThreadedInput::getPacket(pandar_msgs::PandarPacket* pkt)
+{
+  return getPackets(pkt, 1) == 1 ? PacketType::LIDAR : PacketType::ERROR;
+}
+
+size_t ThreadedInput::getPackets(pandar_msgs::PandarPacket* packets, size_t max_packets)
+{
+  const pandar_msgs::PandarPacket* slots;
+  const size_t count = acquire(&slots, max_packets);
+  for (size_t i = 0; i < count; ++i) {
+    packets[i].stamp = slots[i].stamp;
+    packets[i].size = slots[i].size;
+    std::memcpy(packets[i].data.data(), slots[i].data.data(), slots[i].size);
+  }
+  release(count);
+  return count;
+}
+
+size_t ThreadedInput::acquire(const pandar_msgs::PandarPacket** packets, size_t max_packets)
+{
+  size_t count = ring_.readable(packets);
+  if (count == 0) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    not_empty_.wait_for(lock, std::chrono::milliseconds(timeout_),
+                        [this, packets, &count] { return (count = ring_.readable(packets)) > 0; });
+    waiting_.store(false, std::memory_order_relaxed);
+  }
+  return std::min(count, max_packets);
+}
+
+void ThreadedInput::release(size_t count)
+{
+  ring_.pop(count);
+}
+
+ThreadedInput::Stats ThreadedInput::getStats() const
+{
+  Stats stats;
+  stats.capacity = ring_.capacity();
+  stats.occupancy = ring_.occupancy();
+  stats.high_water = ring_.highWater();
+  stats.received = ring_.received();
+  stats.overruns = ring_.overruns();
+  return stats;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "pandar_pointcloud/point_types.hpp"
+
+namespace pandar_pointcloud
+{
+// Recycles scan clouds. A cloud from acquire() comes back to the pool when its last reference is dropped,
+// whichever thread that happens on (decoder, publisher queue or a nodelet subscriber). It is cleared but
+// keeps its capacity, so once warm a rotation reuses memory that is already reserved and faulted in.
+// Clouds released while max_idle clouds are already waiting are freed instead.
+class CloudPool : public std::enable_shared_from_this<CloudPool>
+{
+public:
+  struct Stats
+  {
+    uint64_t hits;       // acquire() served from the pool
+    uint64_t misses;     // acquire() had to allocate
+    uint64_t discarded;  // released while the pool was full
+    size_t idle;
+  };
+
+  static std::shared_ptr<CloudPool> create(size_t reserve_points, size_t max_idle = 4);
+  ~CloudPool();
+
+  PointcloudXYZIRADT acquire();
+  Stats stats() const;
+
+private:
+  CloudPool(size_t reserve_points, size_t max_idle);
+  void release(pcl::PointCloud<PointXYZIRADT>* cloud);
+
+  size_t reserve_points_;
+  size_t max_idle_;
+
+  mutable std::mutex mutex_;
+  std::vector<pcl::PointCloud<PointXYZIRADT>*> idle_;
+  Stats stats_;
+};
+}  // namespace pandar_pointcloud
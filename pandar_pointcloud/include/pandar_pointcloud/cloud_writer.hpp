@@ -0,0 +1,45 @@
+#pragma once
+
+#include <sensor_msgs/PointCloud2.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "pandar_pointcloud/point_types.hpp"
+
+namespace pandar_pointcloud
+{
+// Serialises scans into PointCloud2 messages without pcl_ros. pandar_points_ex gets the PointXYZIRADT
+// layout and pandar_points the PointXYZIR one, the same fields and offsets pcl_ros produced, both written
+// in a single pass over the scan. Messages come from a pool like CloudPool's: released ones keep their
+// data buffer, so once warm a scan is written into memory that is already allocated. Publish them as is,
+// nodelet subscribers in the same process share the message.
+class CloudWriter : public std::enable_shared_from_this<CloudWriter>
+{
+public:
+  static std::shared_ptr<CloudWriter> create(size_t max_idle = 4);
+  ~CloudWriter();
+
+  // Fill the messages that are asked for, a null pointer skips that topic.
+  void write(const pcl::PointCloud<PointXYZIRADT>& cloud, sensor_msgs::PointCloud2Ptr* points_ex,
+             sensor_msgs::PointCloud2Ptr* points);
+
+private:
+  enum Layout
+  {
+    XYZIRADT,
+    XYZIR,
+    LAYOUT_COUNT
+  };
+
+  explicit CloudWriter(size_t max_idle);
+  sensor_msgs::PointCloud2Ptr acquire(Layout layout, const pcl::PointCloud<PointXYZIRADT>& cloud);
+  void release(Layout layout, sensor_msgs::PointCloud2* msg);
+
+  size_t max_idle_;
+  std::vector<sensor_msgs::PointField> fields_[LAYOUT_COUNT];
+  size_t point_step_[LAYOUT_COUNT];
+
+  std::mutex mutex_;
+  std::vector<sensor_msgs::PointCloud2*> idle_[LAYOUT_COUNT];
+};
+}  // namespace pandar_pointcloud
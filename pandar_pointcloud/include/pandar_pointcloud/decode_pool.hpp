@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "pandar_pointcloud/decoder/packet_decoder.hpp"
+
+namespace pandar_pointcloud
+{
+// Decodes the packets of a scan message on persistent threads. The packets are cut into consecutive
+// slices, each decoded by its own clone of the decoder into its own Slice, the calling thread taking the
+// first. The caller then replays the slices in order on the original decoder, which splits scans exactly
+// as decoding them one by one would. Slices keep their capacity, so after the first messages the workers
+// write into memory that is already reserved.
+class DecodePool
+{
+public:
+  struct Packet
+  {
+    const uint8_t* data;
+    size_t size;
+  };
+
+  // threads: slices decoded at once, including the calling thread
+  DecodePool(const PacketDecoder& decoder, size_t threads);
+  ~DecodePool();
+
+  // Decode packets into slices 0..n-1 and return n. Short messages use fewer slices, a slice of only a
+  // few packets is not worth the hand-off.
+  size_t decode(const std::vector<Packet>& packets);
+  // see PacketDecoder::setComputeXYZ(), call between decode()s
+  void setComputeXYZ(bool compute_xyz);
+  const PacketDecoder::Slice& slice(size_t index) const
+  {
+    return slices_[index];
+  }
+
+private:
+  void run(size_t index);
+  void decodeSlice(size_t index);
+
+  std::vector<std::shared_ptr<PacketDecoder>> decoders_;
+  std::vector<PacketDecoder::Slice> slices_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  const std::vector<Packet>* packets_;
+  size_t slice_count_;
+  size_t pending_;
+  uint64_t generation_;
+  bool stop_;
+};
+}  // namespace pandar_pointcloud
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pandar_pointcloud
+{
+// Converts the channel records of one block into points, reading the distances straight from the packet: widen,
+// scale by the distance unit, mask by range, compute xyz from per-channel tables and TrigTable, and compact the
+// valid channels to the front of BlockKernelOutput.
+// instance() dispatches at runtime to AVX2, SSE4.1 or scalar code. A vector kernel is only used after it
+// reproduced the scalar kernel bit for bit on a self-test.
+// the most channels of a block, the channel count of a call must be a multiple of BLOCK_KERNEL_CHANNEL_STEP
+constexpr size_t BLOCK_KERNEL_CHANNELS = 128;
+constexpr size_t BLOCK_KERNEL_CHANNEL_STEP = 8;
+
+struct BlockKernelTables
+{
+  alignas(32) std::array<float, BLOCK_KERNEL_CHANNELS> cos_elev;
+  alignas(32) std::array<float, BLOCK_KERNEL_CHANNELS> sin_elev;
+  // per-channel azimuth offset in TrigTable steps, wrapped into [0, TrigTable::STEPS)
+  alignas(32) std::array<int32_t, BLOCK_KERNEL_CHANNELS> azimuth_offset;
+};
+
+struct BlockKernelParams
+{
+  float distance_unit;  // meters per raw distance count
+  float min_range;      // valid when min_range <= range <= max_range
+  float max_range;
+  bool horizontal_range;  // range is the xy distance instead of the slant distance
+};
+
+struct BlockKernelOutput
+{
+  // vector kernels store whole registers, hence the padding
+  static constexpr size_t CAPACITY = BLOCK_KERNEL_CHANNELS + 8;
+  alignas(32) float x[CAPACITY];
+  alignas(32) float y[CAPACITY];
+  alignas(32) float z[CAPACITY];
+  alignas(32) float distance[CAPACITY];  // slant distance
+  alignas(32) int32_t channel[CAPACITY];
+};
+
+class BlockKernel
+{
+public:
+  using Function = size_t (*)(const uint8_t* records, size_t stride, size_t channels, int azimuth,
+                              const BlockKernelParams& params, const BlockKernelTables& tables, BlockKernelOutput& out);
+  struct Variant
+  {
+    const char* name;
+    Function function;
+  };
+
+  static const BlockKernel& instance();
+
+  // records: channels records stride bytes apart, each starting with a little endian distance count.
+  // Up to 2 bytes past the last distance may be read. azimuth in 0.01 degrees. Returns the number of valid points.
+  size_t operator()(const uint8_t* records, size_t stride, size_t channels, int azimuth,
+                    const BlockKernelParams& params, const BlockKernelTables& tables, BlockKernelOutput& out) const
+  {
+    return function_(records, stride, channels, azimuth, params, tables, out);
+  }
+  const char* name() const { return name_; }
+
+  // Compares a kernel with the scalar one on synthetic blocks, true when every output is identical.
+  static bool selfCheck(Function function);
+  // The kernels this CPU can run, scalar first and the fastest last, self-checked or not.
+  static std::vector<Variant> variants();
+
+private:
+  BlockKernel();
+
+  Function function_;
+  const char* name_;
+};
+}  // namespace pandar_pointcloud
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include "pandar_pointcloud/calibration.hpp"
+#include "block_kernel.hpp"
+#include "packet_decoder.hpp"
+#include "trig_table.hpp"
+#include "unit_vector_table.hpp"
+#include "utc_time.hpp"
+
+namespace pandar_pointcloud
+{
+// The decoding shared by all sensor models. A model decoder derives from
+// DecoderEngine<ModelDecoder, Packet, Channels> and supplies only what is specific to the model:
+//   bool parsePacket(const uint8_t* data, size_t size)  validates the datagram and sets packet_
+//   double packetTime()                                sensor time (ppt/gps) of packet_
+//   void convertPacket()                               its blocks, usually through convertBlocks()
+// plus its firing/block timing and return mode semantics, building points with makePoint() or, for single
+// return blocks, convertKernelBlock(). Channel tables, unit vectors and the BlockKernel live here, so they
+// serve every model.
+template <class Derived, class Packet, size_t Channels>
+class DecoderEngine : public PacketDecoder
+{
+  static_assert(Channels <= BLOCK_KERNEL_CHANNELS, "more channels than the block kernel holds");
+
+public:
+  using PacketDecoder::unpack;
+  void unpack(const uint8_t* data, size_t size) override
+  {
+    Derived& model = static_cast<Derived&>(*this);
+    if (!model.parsePacket(data, size)) {
+      return;
+    }
+    packet_time_ = model.packetTime();
+    beginPacket();
+    model.convertPacket();
+    endPacket();
+  }
+
+  size_t setUnitVectorResolution(double resolution) override
+  {
+    unit_vectors_.reset();
+    if (resolution > 0.0) {
+      unit_vectors_.reset(new UnitVectorTable(elev_angle_.data(), azimuth_offset_.data(), Channels, resolution));
+    }
+    return unit_vectors_ ? unit_vectors_->bytes() : 0;
+  }
+
+  std::shared_ptr<PacketDecoder> clone() const override
+  {
+    return std::make_shared<Derived>(static_cast<const Derived&>(*this));
+  }
+
+protected:
+  // a block converter, chosen once per packet so the per-point loops do not branch on return modes
+  using ConvertBlock = void (Derived::*)(int block_id);
+
+  DecoderEngine(size_t max_points, float scan_phase) : PacketDecoder(Channels, max_points, scan_phase)
+  {
+  }
+
+  // elevation and azimuth offset of every channel in degrees
+  void setChannelAngles(const float* elev_angle, const float* azimuth_offset)
+  {
+    for (size_t channel = 0; channel < Channels; ++channel) {
+      elev_angle_[channel] = elev_angle[channel];
+      azimuth_offset_[channel] = azimuth_offset[channel];
+      const double elev = elev_angle_[channel] * M_PI / 180.0;
+      cos_elev_angle_[channel] = cosf(elev);
+      sin_elev_angle_[channel] = sinf(elev);
+      azimuth_offset_steps_[channel] = TrigTable::toSteps(azimuth_offset_[channel]);
+      azimuth_offset_centideg_[channel] = std::round(azimuth_offset_[channel] * 100.0f);
+      kernel_tables_.cos_elev[channel] = cos_elev_angle_[channel];
+      kernel_tables_.sin_elev[channel] = sin_elev_angle_[channel];
+      kernel_tables_.azimuth_offset[channel] = TrigTable::wrap(azimuth_offset_steps_[channel]);
+    }
+  }
+  void setChannelAngles(Calibration& calibration)
+  {
+    // TODO: add calibration data validation
+    std::array<float, Channels> elev_angle;
+    std::array<float, Channels> azimuth_offset;
+    for (size_t channel = 0; channel < Channels; ++channel) {
+      elev_angle[channel] = calibration.elev_angle_map[channel];
+      azimuth_offset[channel] = calibration.azimuth_offset_map[channel];
+    }
+    setChannelAngles(elev_angle.data(), azimuth_offset.data());
+  }
+
+  // checkPhase() on every step-th block of packet_ and convert it
+  void convertBlocks(size_t block_count, size_t step, ConvertBlock convert)
+  {
+    Derived& model = static_cast<Derived&>(*this);
+    for (size_t block_id = 0; block_id < block_count; block_id += step) {
+      checkPhase(packet_->blocks[block_id].azimuth);
+      (model.*convert)(block_id);
+    }
+  }
+
+  // the BlockKernel computes xyz with TrigTable lookups, neither unit vectors nor images only use it
+  bool useBlockKernel() const
+  {
+    return !unit_vectors_ && computeXYZ();
+  }
+
+  // valid returns of the scalar path
+  static bool inRange(double distance)
+  {
+    return distance > 0.1 && distance <= 200.0;
+  }
+
+  // A return of channel in a block fired at azimuth (0.01 degrees), distance in meters. The model stamps
+  // time_stamp.
+  PointXYZIRADT makePoint(size_t channel, uint16_t azimuth, double distance, uint8_t intensity,
+                          uint8_t return_type) const
+  {
+    PointXYZIRADT point;
+    if (!computeXYZ()) {
+      point.x = point.y = point.z = std::numeric_limits<float>::quiet_NaN();
+    }
+    else if (unit_vectors_) {
+      const auto& direction = unit_vectors_->at(channel, azimuth);
+      point.x = static_cast<float>(distance * direction.x);
+      point.y = static_cast<float>(distance * direction.y);
+      point.z = static_cast<float>(distance * direction.z);
+    }
+    else {
+      const int steps = azimuth + azimuth_offset_steps_[channel];
+      const double xy_distance = distance * cos_elev_angle_[channel];
+      point.x = static_cast<float>(xy_distance * trig_.sin(steps));
+      point.y = static_cast<float>(xy_distance * trig_.cos(steps));
+      point.z = static_cast<float>(distance * sin_elev_angle_[channel]);
+    }
+    point.intensity = intensity;
+    point.distance = distance;
+    point.ring = channel;
+    point.azimuth = azimuth + azimuth_offset_centideg_[channel];
+    point.return_type = return_type;
+    return point;
+  }
+
+  // The valid returns of a single return block through the BlockKernel, in channel order as the scalar path
+  // adds them. distance_unit in meters per count, time(channel) gives each point's time_stamp.
+  template <class Block, class Time>
+  void convertKernelBlock(const Block& block, float distance_unit, uint8_t return_type, Time time)
+  {
+    const BlockKernelParams params{ distance_unit, KERNEL_MIN_RANGE, KERNEL_MAX_RANGE, false };
+    const size_t count = block_kernel_(reinterpret_cast<const uint8_t*>(block.units), sizeof(block.units[0]),
+                                       Channels, block.azimuth, params, kernel_tables_, kernel_output_);
+    for (size_t n = 0; n < count; ++n) {
+      const size_t channel = kernel_output_.channel[n];
+      PointXYZIRADT point;
+      point.x = kernel_output_.x[n];
+      point.y = kernel_output_.y[n];
+      point.z = kernel_output_.z[n];
+      point.intensity = block.units[channel].intensity;
+      point.distance = kernel_output_.distance[n];
+      point.ring = channel;
+      point.azimuth = block.azimuth + azimuth_offset_centideg_[channel];
+      point.return_type = return_type;
+      point.time_stamp = time(channel);
+      addPoint(point);
+    }
+  }
+
+  // the datagram being unpacked
+  const Packet* packet_ = nullptr;
+  UtcEpochCache utc_cache_;
+  double packet_time_ = 0.0;
+
+  std::array<float, Channels> elev_angle_{};
+  std::array<float, Channels> azimuth_offset_{};
+  std::array<float, Channels> cos_elev_angle_{};
+  std::array<float, Channels> sin_elev_angle_{};
+  // azimuth_offset_ in TrigTable steps, and rounded to the 0.01 degrees of PointXYZIRADT::azimuth
+  std::array<int, Channels> azimuth_offset_steps_{};
+  std::array<float, Channels> azimuth_offset_centideg_{};
+  const TrigTable& trig_ = TrigTable::instance();
+  // shared with clone()s
+  std::shared_ptr<const UnitVectorTable> unit_vectors_;
+  const BlockKernel& block_kernel_ = BlockKernel::instance();
+  BlockKernelTables kernel_tables_;
+  BlockKernelOutput kernel_output_;
+
+private:
+  // distances are whole millimetres, the half millimetre margins keep the (0.1, 200] test of inRange()
+  static constexpr float KERNEL_MIN_RANGE = 0.1005f;
+  static constexpr float KERNEL_MAX_RANGE = 200.0005f;
+  static_assert(Channels % BLOCK_KERNEL_CHANNEL_STEP == 0, "block kernel channel count");
+};
+}  // namespace pandar_pointcloud
@@ -1,22 +1,284 @@
 #pragma once
 
 #include <pandar_msgs/PandarPacket.h>
+#include <sensor_msgs/Image.h>
+#include <algorithm>
 #include <fstream>
+#include <memory>
 #include <vector>
+#include "pandar_pointcloud/cloud_pool.hpp"
+#include "pandar_pointcloud/image_pool.hpp"
 #include "pandar_pointcloud/point_types.hpp"
 
 namespace pandar_pointcloud
 {
+// pixels of the range image: metres (32FC1, NaN without a return) or ticks of a fixed unit (16UC1, 0)
+enum class RangeImageEncoding
+{
+  FLOAT_METERS,
+  UINT16_TICKS,
+};
+
 class PacketDecoder
 {
 public:
+  // Packets decoded by a clone() on another thread: their points, and the azimuth and first point of every
+  // block so replay() can split scans exactly as unpack() would have. Cleared slices keep their capacity.
+  struct Slice
+  {
+    struct Block
+    {
+      uint16_t azimuth;
+      size_t first_point;
+    };
+    struct Packet
+    {
+      bool valid;        // false when the decoder rejected the packet
+      size_t block_end;  // blocks of this and all earlier packets
+      size_t returns;    // setPacketReturns() of the packet, 0 when the decoder does not set it
+    };
+    pcl::PointCloud<PointXYZIRADT>::VectorType points;
+    // the range of every point for decoders that add points with a range, empty for the others
+    std::vector<float> ranges;
+    std::vector<Block> blocks;
+    std::vector<Packet> packets;
+
+    void clear()
+    {
+      points.clear();
+      ranges.clear();
+      blocks.clear();
+      packets.clear();
+    }
+  };
+
   virtual ~PacketDecoder(){};
-  virtual void unpack(const pandar_msgs::PandarPacket& raw_packet) = 0;
+  void unpack(const pandar_msgs::PandarPacket& raw_packet)
+  {
+    unpack(raw_packet.data.data(), raw_packet.size);
+  }
+  // Decode one raw lidar datagram, e.g. a slice of a PandarCompactScan.
+  virtual void unpack(const uint8_t* data, size_t size) = 0;
 
   // TODO: Remove this function
   // In Hesai's original driver, the decoder controls how many packets are used, but now the pandar_driver controls it.
-  virtual bool hasScanned() = 0;
+  bool hasScanned() const
+  {
+    return has_scanned_;
+  }
+
+  // The last completed scan.
+  PointcloudXYZIRADT getPointcloud() const
+  {
+    return scan_pc_;
+  }
+  // The cloud currently being filled: the next scan once hasScanned(), otherwise the current one.
+  PointcloudXYZIRADT getPartialPointcloud() const
+  {
+    return buffer_pc_;
+  }
+
+  // Scan clouds are drawn from this pool and return to it once every subscriber released them.
+  CloudPool::Stats cloudPoolStats() const
+  {
+    return cloud_pool_->stats();
+  }
+
+  // Build a per-(channel, azimuth) unit vector table at the given resolution in degrees, 0 drops it and
+  // goes back to TrigTable lookups. Returns the table size in bytes. The table replaces the block kernel
+  // with a scalar loop and only pays off for 32 channels at coarse resolutions, on 64 and 128 channel
+  // sensors it is slower than the default (decoder_benchmark unit_vectors).
+  virtual size_t setUnitVectorResolution(double resolution) = 0;
+
+  // A decoder with the same configuration, unit vectors included, for unpackSlice() on another thread. It
+  // has no scan buffer, so unpack() must not be called on it.
+  virtual std::shared_ptr<PacketDecoder> clone() const = 0;
+
+  // Lay scans out as an organized grid: a row per channel, a column per azimuth_resolution degrees
+  // starting at scan_phase, returns points per column. The returns of one firing fill a column in the
+  // order the decoder emits them, cells without a return have NaN coordinates. Columns widen when a
+  // packet carries more returns, see setPacketReturns(). 0 goes back to unorganized clouds. Drops the
+  // scan in progress, so set it before decoding.
+  void setOrganized(double azimuth_resolution, size_t returns);
+  bool isOrganized() const
+  {
+    return grid_columns_ > 0;
+  }
+
+  // Also fill a range and an intensity (mono8) image per scan, a row per channel and a column per
+  // azimuth_resolution degrees from scan_phase, holding the last return decoded into each pixel.
+  // tick: metres per count of UINT16_TICKS. 0 resolution drops the images.
+  void setImages(double azimuth_resolution, RangeImageEncoding encoding, double tick);
+  bool hasImages() const
+  {
+    return image_columns_ > 0;
+  }
+  // The images of the last completed scan.
+  sensor_msgs::ImagePtr getRangeImage() const
+  {
+    return range_scan_image_;
+  }
+  sensor_msgs::ImagePtr getIntensityImage() const
+  {
+    return intensity_scan_image_;
+  }
+
+  // false leaves x, y and z NaN, for when only the images are used; the other fields are still set.
+  void setComputeXYZ(bool compute_xyz)
+  {
+    compute_xyz_ = compute_xyz;
+  }
+
+  // Decode one datagram and append it to slice instead of the scan.
+  void unpackSlice(const uint8_t* data, size_t size, Slice& slice);
+  // Continue the scan with packet index of a slice, as if unpack() had decoded it here.
+  void replay(const Slice& slice, size_t index);
+
+protected:
+  // channels: rows of an organized scan. max_points: the most points one rotation can hold, pooled scan
+  // clouds are reserved for it.
+  PacketDecoder(size_t channels, size_t max_points, float scan_phase);
+  // shares the configuration and cloud pool, see clone()
+  PacketDecoder(const PacketDecoder& other);
+
+  // Decoders call beginPacket() and endPacket() around each packet, checkPhase() with the azimuth of every
+  // block before its points, and addPoint() for each point.
+  bool computeXYZ() const
+  {
+    return compute_xyz_;
+  }
+
+  void beginPacket()
+  {
+    has_scanned_ = false;
+    if (slice_) {
+      slice_->packets.push_back({ true, 0, 0 });
+    }
+  }
+  // Decoders that emit every return in the packet, whatever the configured return mode, give the points
+  // per channel they add after each checkPhase() of this packet.
+  void setPacketReturns(size_t returns)
+  {
+    if (slice_) {
+      slice_->packets.back().returns = returns;
+      return;
+    }
+    if (grid_columns_ > 0 && returns > grid_returns_) {
+      widenGrid(returns);
+    }
+  }
+  void checkPhase(uint16_t azimuth)
+  {
+    if (slice_) {
+      slice_->blocks.push_back({ azimuth, points_->size() });
+      return;
+    }
+    int current_phase = (static_cast<int>(azimuth) - scan_phase_ + 36000) % 36000;
+    if (current_phase <= last_phase_ && !has_scanned_) {
+      scan_split_ = buffer_pc_->points.size();
+      has_scanned_ = true;
+      if (grid_columns_ > 0) {
+        splitGrid();
+      }
+      if (image_columns_ > 0) {
+        splitImages();
+      }
+    }
+    last_phase_ = current_phase;
+    if (image_columns_ > 0) {
+      image_column_ = static_cast<size_t>(current_phase) * image_columns_ / 36000;
+    }
+    if (grid_columns_ > 0) {
+      // a new column starts with no returns filled
+      const size_t column = static_cast<size_t>(current_phase) * grid_columns_ / 36000;
+      if (column != grid_column_) {
+        grid_column_ = column;
+        std::fill(grid_filled_.begin(), grid_filled_.end(), 0);
+      }
+    }
+  }
+  void addPoint(const PointXYZIRADT& point)
+  {
+    storePoint(point, point.distance);
+  }
+  // range: the slant distance for the range image, for decoders whose point.distance is another distance
+  void addPoint(const PointXYZIRADT& point, float range)
+  {
+    if (slice_) {
+      slice_->ranges.push_back(range);
+    }
+    storePoint(point, range);
+  }
+  void endPacket();
+
+private:
+  void storePoint(const PointXYZIRADT& point, float range)
+  {
+    if (image_columns_ > 0 && !slice_) {
+      setPixel(point, range);
+    }
+    if (grid_columns_ > 0 && !slice_) {
+      uint8_t& filled = grid_filled_[point.ring];
+      if (filled < grid_returns_) {
+        (*points_)[(point.ring * grid_columns_ + grid_column_) * grid_returns_ + filled++] = point;
+      }
+      return;
+    }
+    points_->push_back(point);
+  }
+
+  // organized mode: a NaN filled grid from the pool, and handing over the buffer at the split itself
+  PointcloudXYZIRADT acquireGrid();
+  void splitGrid();
+  void widenGrid(size_t returns);
+  void splitImages();
+  void setPixel(const PointXYZIRADT& point, float range)
+  {
+    const size_t pixel = point.ring * image_columns_ + image_column_;
+    if (range_encoding_ == RangeImageEncoding::FLOAT_METERS) {
+      reinterpret_cast<float*>(range_image_->data.data())[pixel] = range;
+    }
+    else {
+      reinterpret_cast<uint16_t*>(range_image_->data.data())[pixel] =
+          static_cast<uint16_t>(std::min(range * range_ticks_per_meter_ + 0.5f, 65535.0f));
+    }
+    intensity_image_->data[pixel] = static_cast<uint8_t>(point.intensity);
+  }
+
+  std::shared_ptr<CloudPool> cloud_pool_;
+  size_t channels_;
+  uint16_t scan_phase_;
+  int last_phase_;
+  bool has_scanned_;
+
+  // Points are written straight into buffer_pc_, the points before scan_split_ belong to the scan that
+  // completed in this packet. scan_pc_ is the completed scan.
+  PointcloudXYZIRADT buffer_pc_;
+  size_t scan_split_;
+  PointcloudXYZIRADT scan_pc_;
+
+  // where addPoint() writes: buffer_pc_, or the points of slice_ inside unpackSlice()
+  pcl::PointCloud<PointXYZIRADT>::VectorType* points_;
+  Slice* slice_;
+
+  // organized grid layout, columns 0 when unorganized; grid_filled_ counts the returns of each channel
+  // in the current column, later returns in a full cell are dropped
+  size_t grid_columns_;
+  size_t grid_returns_;
+  size_t grid_column_;
+  std::vector<uint8_t> grid_filled_;
 
-  virtual PointcloudXYZIRADT getPointcloud() = 0;
+  // range and intensity images: being filled, and of the last completed scan, drawn from a pool per kind
+  std::shared_ptr<ImagePool> range_image_pool_;
+  std::shared_ptr<ImagePool> intensity_image_pool_;
+  size_t image_columns_;
+  size_t image_column_;
+  RangeImageEncoding range_encoding_;
+  float range_ticks_per_meter_;
+  sensor_msgs::ImagePtr range_image_;
+  sensor_msgs::ImagePtr intensity_image_;
+  sensor_msgs::ImagePtr range_scan_image_;
+  sensor_msgs::ImagePtr intensity_scan_image_;
+  bool compute_xyz_;
 };
-}  // namespace pandar_pointcloud
\ No newline at end of file
+}  // namespace pandar_pointcloud
@@ -26,27 +26,44 @@ constexpr double LASER_RETURN_TO_DISTANCE_RATE = 0.004;
 constexpr uint32_t STRONGEST_RETURN = 0x37;
 constexpr uint32_t LAST_RETURN = 0x38;
 constexpr uint32_t DUAL_RETURN = 0x39;
+// 0.2 degree firings at 10 Hz, two returns
+constexpr size_t MAX_POINTS_PER_SCAN = LASER_COUNT * 1800 * 2;
 
+// Wire layout, decoders read these straight from the received datagram.
+#pragma pack(push, 1)
 struct Unit
 {
+  uint16_t distance;  // LASER_RETURN_TO_DISTANCE_RATE meters
   uint8_t intensity;
-  double distance;
 };
 
 struct Block
 {
-  uint16_t azimuth;
   uint16_t sob;
+  uint16_t azimuth;
   Unit units[LASER_COUNT];
 };
 
+struct Tail
+{
+  uint8_t reserved[RESERVE_SIZE];
+  uint16_t revolution;
+  uint32_t timestamp;  // us
+  uint8_t return_mode;
+  uint8_t factory_info;
+  uint8_t date_time[UTC_TIME];
+};
+
+// optionally followed by a SEQ_NUM_SIZE udp sequence
 struct Packet
 {
   Block blocks[BLOCKS_PER_PACKET];
-  struct tm t;
-  uint32_t usec;
-  uint32_t return_mode;
+  Tail tail;
 };
+#pragma pack(pop)
+
+static_assert(sizeof(Block) == BLOCK_SIZE, "Pandar40 block layout");
+static_assert(sizeof(Packet) == PACKET_SIZE, "Pandar40 packet layout");
 
 }  // namespace pandar40
 }  // namespace pandar_pointcloud
\ No newline at end of file
@@ -1,15 +1,14 @@
 #pragma once
 
 #include <array>
-#include "pandar_pointcloud/calibration.hpp"
-#include "packet_decoder.hpp"
+#include "decoder_engine.hpp"
 #include "pandar40.hpp"
 
 namespace pandar_pointcloud
 {
 namespace pandar40
 {
-class Pandar40Decoder : public PacketDecoder
+class Pandar40Decoder : public DecoderEngine<Pandar40Decoder, Packet, LASER_COUNT>
 {
 public:
   enum class ReturnMode : int8_t
@@ -31,18 +30,21 @@ public:
   };
 
   Pandar40Decoder(Calibration& calibration, float scan_phase = 0.0f, double dual_return_distance_threshold = 0.1, ReturnMode return_mode = ReturnMode::DUAL);
-  void unpack(const pandar_msgs::PandarPacket& raw_packet) override;
-  bool hasScanned() override;
-  PointcloudXYZIRADT getPointcloud() override;
 
 private:
-  bool parsePacket(const pandar_msgs::PandarPacket& raw_packet);
+  using Engine = DecoderEngine<Pandar40Decoder, Packet, LASER_COUNT>;
+  friend Engine;
+
+  bool parsePacket(const uint8_t* data, size_t size);
+  double packetTime();
+  void convertPacket();
+  double distance(const Unit& unit) const;
+  template <bool Dual>
   PointXYZIRADT build_point(int block_id, int unit_id, uint8_t return_type);
-  PointcloudXYZIRADT convert(const int block_id);
-  PointcloudXYZIRADT convert_dual(const int block_id);
-
-  std::array<float, LASER_COUNT> elev_angle_;
-  std::array<float, LASER_COUNT> azimuth_offset_;
+  void convert(const int block_id);
+  template <ReturnMode Mode>
+  void convert_dual(const int block_id);
+  ConvertBlock selectConvert(bool dual_return) const;
 
   std::array<float, LASER_COUNT> firing_offset_;
   std::array<float, BLOCKS_PER_PACKET> block_offset_single_;
@@ -52,14 +54,6 @@ private:
 
   ReturnMode return_mode_;
   double dual_return_distance_threshold_;
-  Packet packet_;
-
-  PointcloudXYZIRADT scan_pc_;
-  PointcloudXYZIRADT overflow_pc_;
-
-  uint16_t scan_phase_;
-  int last_phase_;
-  bool has_scanned_;
 };
 
 }  // namespace pandar40
@@ -34,22 +34,27 @@ namespace pandar_pointcloud
     constexpr uint32_t STRONGEST_RETURN = 0x37;
     constexpr uint32_t LAST_RETURN = 0x38;
     constexpr uint32_t DUAL_RETURN = 0x39;
+    // 0.2 degree firings at 10 Hz, two returns
+    constexpr size_t MAX_POINTS_PER_SCAN = UNIT_NUM * 1800 * 2;
 
+    // Wire layout, decoders read these straight from the received datagram.
+#pragma pack(push, 1)
     struct Header
     {
-      uint16_t sob;            // 0xEEFF 2bytes
+      uint16_t sob;            // 0xEE 0xFF on the wire, 0xFFEE read little endian
       int8_t chLaserNumber;    // laser number 1byte
       int8_t chBlockNumber;    // block number 1byte
       int8_t chReturnType;     // return mode 1 byte  when dual return 0-Single Return
       // 1-The first block is the 1 st return.
       // 2-The first block is the 2 nd return
       int8_t chDisUnit;        // Distance unit, 4mm
+      uint8_t reserved[2];
     };
 
     struct Unit
     {
-      double distance;
-      uint16_t intensity;
+      uint16_t distance;  // chDisUnit millimeters
+      uint8_t intensity;
     };
 
     struct Block
@@ -58,13 +63,27 @@ namespace pandar_pointcloud
       Unit units[UNIT_NUM];
     };
 
+    struct Tail
+    {
+      uint8_t reserved[RESERVED_SIZE];  // includes the high temperature flag
+      uint16_t motor_speed;
+      uint32_t timestamp;  // us
+      uint8_t return_mode;
+      uint8_t factory_info;
+      uint8_t date_time[UTC_SIZE];
+    };
+
+    // optionally followed by a 4 byte udp sequence
     struct Packet
     {
       Header header;
       Block blocks[BLOCK_NUM];
-      uint32_t usec;  // ms
-      uint32_t return_mode;
-      tm t;
+      Tail tail;
     };
+#pragma pack(pop)
+
+    static_assert(sizeof(Header) == HEAD_SIZE, "Pandar64 header layout");
+    static_assert(sizeof(Block) == BLOCK_SIZE, "Pandar64 block layout");
+    static_assert(sizeof(Packet) == PACKET_WITHOUT_UDPSEQ_SIZE, "Pandar64 packet layout");
   }  // namespace pandar_64
 }  // namespace pandar_pointcloud
@@ -22,6 +22,7 @@ constexpr uint8_t HIGH_RES_STATE = 0x00;
 constexpr uint8_t STANDARD_RES_STATE = 0x01;
 
 constexpr uint16_t MAX_AZIMUTH_STEPS = 3600; // High Res mode
+constexpr size_t MAX_POINTS_PER_SCAN = LASER_COUNT * MAX_AZIMUTH_STEPS;
 constexpr float DISTANCE_UNIT = 0.004f; // 4mm
 
 constexpr uint8_t HEADER_SIZE = 12;
@@ -33,6 +34,7 @@ constexpr float MIN_RANGE = 0.1;
 constexpr float MAX_RANGE = 230.0;
 constexpr uint16_t THREE_SIXTY = 360;
 
+// Wire layout, decoders read these straight from the received datagram.
 #pragma pack(push, 1)
 struct Header { // 12 bytes
   // Pre header
@@ -117,5 +119,10 @@ struct PacketExtended {
   Tail tail;
 };
 #pragma pack(pop)
+
+static_assert(sizeof(Header) == HEADER_SIZE, "Pandar128E4X header layout");
+static_assert(sizeof(Body) == BODY_SIZE, "Pandar128E4X body layout");
+static_assert(sizeof(Tail) == TAIL_SIZE, "Pandar128E4X tail layout");
+static_assert(sizeof(Packet) == PACKET_SIZE, "Pandar128E4X packet layout");
 }  // namespace pandar_128_e4x
 }  // namespace pandar_pointcloud
\ No newline at end of file
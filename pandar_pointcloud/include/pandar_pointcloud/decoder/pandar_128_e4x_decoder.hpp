@@ -1,15 +1,13 @@
 #pragma once
 
-#include <array>
-#include "pandar_pointcloud/calibration.hpp"
-#include "packet_decoder.hpp"
+#include "decoder_engine.hpp"
 #include "pandar_128_e4x.hpp"
 
 namespace pandar_pointcloud
 {
 namespace pandar_128_e4x
 {
-class Pandar128E4XDecoder : public PacketDecoder
+class Pandar128E4XDecoder : public DecoderEngine<Pandar128E4XDecoder, Packet, LASER_COUNT>
 {
 public:
   enum class ReturnMode : int8_t
@@ -36,33 +34,23 @@ public:
                       float scan_phase = 0.0f,
                       double dual_return_distance_threshold = 0.1,
                       ReturnMode return_mode = ReturnMode::DUAL);
-  void unpack(const pandar_msgs::PandarPacket& raw_packet) override;
-  bool hasScanned() override;
-  PointcloudXYZIRADT getPointcloud() override;
 
 private:
-  bool parsePacket(const pandar_msgs::PandarPacket& raw_packet);
+  using Engine = DecoderEngine<Pandar128E4XDecoder, Packet, LASER_COUNT>;
+  friend Engine;
+
+  bool parsePacket(const uint8_t* data, size_t size);
+  double packetTime();
+  void convertPacket();
   PointXYZIRADT build_point(const Block& block,
                             const size_t& laser_id,
                             const uint16_t& azimuth,
-                            const double& unix_second);
-  PointcloudXYZIRADT convert();
-  PointcloudXYZIRADT convert_dual();
-
-  std::array<float, LASER_COUNT> elev_angle_{};
-  std::array<float, LASER_COUNT> elev_angle_rad_{};
-  std::array<float, LASER_COUNT> cos_elev_angle_{};
-  std::array<float, LASER_COUNT> sin_elev_angle_{};
-  std::array<float, LASER_COUNT> azimuth_offset_{};
-
-  Packet packet_{};
-
-  PointcloudXYZIRADT scan_pc_;
-  PointcloudXYZIRADT overflow_pc_;
+                            const double& packet_time);
+  void convert(const Block* block, uint16_t azimuth);
+  void convertBlock(const Block* block, uint16_t azimuth);
+  void convert_dual();
 
-  uint16_t scan_phase_;
-  int last_phase_;
-  bool has_scanned_;
+  const BlockKernelParams kernel_params_{ DISTANCE_UNIT, MIN_RANGE, MAX_RANGE, true };
 
   double dual_return_distance_threshold_;
 };
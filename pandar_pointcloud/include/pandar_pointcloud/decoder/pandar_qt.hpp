@@ -36,25 +36,31 @@ constexpr size_t PACKET_WITHOUT_UDPSEQ_SIZE = HEAD_SIZE + BODY_SIZE + PACKET_TAI
 constexpr uint32_t FIRST_RETURN = 0x33;
 constexpr uint32_t LAST_RETURN = 0x38;
 constexpr uint32_t DUAL_RETURN = 0x3B;
+// 0.6 degree firings at 10 Hz, two returns
+constexpr size_t MAX_POINTS_PER_SCAN = UNIT_NUM * 600 * 2;
 
+// Wire layout, decoders read these straight from the received datagram.
+#pragma pack(push, 1)
 struct Header
 {
-  uint16_t sob;            // 0xFFEE 2bytes
+  uint16_t sob;            // 0xEE 0xFF on the wire, 0xFFEE read little endian
   int8_t chProtocolMajor;  // Protocol Version Major 1byte
   int8_t chProtocolMinor;  // Protocol Version Minor 1byte
+  uint8_t reserved[2];
   int8_t chLaserNumber;    // laser number 1byte
   int8_t chBlockNumber;    // block number 1byte
   int8_t chReturnType;     // return mode 1 byte  when dual return 0-Single Return
                            // 1-The first block is the 1 st return.
                            // 2-The first block is the 2 nd return
   int8_t chDisUnit;        // Distance unit, 4mm
+  uint8_t reserved_2[2];
 };
 
 struct Unit
 {
-  double distance;
-  uint16_t intensity;
-  uint16_t confidence;
+  uint16_t distance;  // chDisUnit millimeters
+  uint8_t intensity;
+  uint8_t confidence;
 };
 
 struct Block
@@ -63,13 +69,27 @@ struct Block
   Unit units[UNIT_NUM];
 };
 
+struct Tail
+{
+  uint8_t reserved[RESERVED_SIZE];
+  uint16_t motor_speed;
+  uint32_t timestamp;  // us
+  uint8_t return_mode;
+  uint8_t factory_info;
+  uint8_t date_time[UTC_SIZE];
+};
+
+// optionally followed by a SEQUENCE_SIZE udp sequence
 struct Packet
 {
   Header header;
   Block blocks[BLOCK_NUM];
-  uint32_t usec;  // ms
-  uint32_t return_mode;
-  tm t;
+  Tail tail;
 };
+#pragma pack(pop)
+
+static_assert(sizeof(Header) == HEAD_SIZE, "PandarQT header layout");
+static_assert(sizeof(Block) == BLOCK_SIZE, "PandarQT block layout");
+static_assert(sizeof(Packet) == PACKET_WITHOUT_UDPSEQ_SIZE, "PandarQT packet layout");
 }  // namespace pandar_qt
 }  // namespace pandar_pointcloud
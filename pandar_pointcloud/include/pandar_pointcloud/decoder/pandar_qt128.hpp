@@ -51,14 +51,20 @@ constexpr std::size_t PACKET_SIZE =
 constexpr uint32_t FIRST_RETURN = 0x33;
 constexpr uint32_t LAST_RETURN = 0x38;
 constexpr uint32_t DUAL_RETURN = 0x3B;
+// 0.4 degree firings at 10 Hz, two returns
+constexpr std::size_t MAX_POINTS_PER_SCAN = UNIT_NUM * 900 * 2;
 
+// Wire layout, decoders read these straight from the received datagram.
+#pragma pack(push, 1)
 struct Header
 {
-  std::uint16_t u16Sob;          // Start of block 0xFFEE 2bytes
+  std::uint16_t u16Sob;          // Start of block 0xEE 0xFF on the wire, 0xFFEE read little endian
   std::uint8_t u8ProtocolMajor;  // Protocol Version Major 1byte
   std::uint8_t u8ProtocolMinor;  // Protocol Version Minor 1byte
+  std::uint8_t u8Reserved1[2];
   std::uint8_t u8LaserNum;       // Laser Num 1byte (0x80 = 128 channels)
   std::uint8_t u8BlockNum;       // Block Num 1byte (0x02 = 2 blocks per packe)
+  std::uint8_t u8Reserved2;
   std::uint8_t u8DistUnit;       // Distance unit 1byte (0x04 = 4mm)
   std::uint8_t u8EchoNum;        // Number of returns that each channel generates. 1byte
   std::uint8_t u8Flags;          // Flags 1byte
@@ -66,8 +72,9 @@ struct Header
 
 struct Unit
 {
-  double distance;
-  std::uint16_t intensity;
+  std::uint16_t distance;  // u8DistUnit millimeters
+  std::uint8_t intensity;
+  std::uint8_t confidence;
 };
 
 struct Block
@@ -76,15 +83,34 @@ struct Block
   Unit units[UNIT_NUM];
 };
 
+struct Tail
+{
+  std::uint8_t reserved1[RESERVED_1_SIZE];
+  std::uint8_t mode_flag;
+  std::uint8_t reserved2[RESERVED_2_SIZE];
+  std::uint8_t return_mode;
+  std::uint16_t motor_speed;
+  std::uint8_t date_time[DATE_TIME_SIZE];
+  std::uint32_t timestamp;  // us
+  std::uint8_t factory_info;
+  std::uint32_t udp_sequence;
+  std::uint32_t crc_3;
+};
+
 struct Packet
 {
   Header header;
   Block blocks[BLOCK_NUM];
-  std::uint32_t timestamp;  // ms
-  std::uint32_t mode_flag;
-  uint32_t usec;  // ms
-  uint32_t return_mode;
-  tm t;
+  std::uint32_t crc_1;
+  std::uint8_t functional_safety[FUNCTIONAL_SAFETY_SIZE];
+  Tail tail;
+  std::uint8_t cyber_security[CYBER_SECURITY_SIZE];
 };
+#pragma pack(pop)
+
+static_assert(sizeof(Header) == HEAD_SIZE, "PandarQT128 header layout");
+static_assert(sizeof(Block) == BLOCK_SIZE, "PandarQT128 block layout");
+static_assert(sizeof(Tail) == PACKET_TAIL_SIZE, "PandarQT128 tail layout");
+static_assert(sizeof(Packet) == PACKET_SIZE, "PandarQT128 packet layout");
 }  // namespace pandar_qt128
 }  // namespace pandar_pointcloud
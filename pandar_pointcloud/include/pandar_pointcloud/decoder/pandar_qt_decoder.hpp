@@ -1,15 +1,14 @@
 #pragma once
 
 #include <array>
-#include "pandar_pointcloud/calibration.hpp"
-#include "packet_decoder.hpp"
+#include "decoder_engine.hpp"
 #include "pandar_qt.hpp"
 
 namespace pandar_pointcloud
 {
 namespace pandar_qt
 {
-class PandarQTDecoder : public PacketDecoder
+class PandarQTDecoder : public DecoderEngine<PandarQTDecoder, Packet, UNIT_NUM>
 {
 public:
   enum class ReturnMode : int8_t
@@ -29,18 +28,23 @@ public:
   };
 
   PandarQTDecoder(Calibration& calibration, float scan_phase = 0.0f, double dual_return_distance_threshold = 0.1, ReturnMode return_mode = ReturnMode::DUAL);
-  void unpack(const pandar_msgs::PandarPacket& raw_packet) override;
+  template <bool Dual>
   PointXYZIRADT build_point(int block_id, int unit_id, uint8_t return_type);
-  bool hasScanned() override;
-  PointcloudXYZIRADT getPointcloud() override;
 
 private:
-  bool parsePacket(const pandar_msgs::PandarPacket& raw_packet);
-  PointcloudXYZIRADT convert(const int block_id);
-  PointcloudXYZIRADT convert_dual(const int block_id);
-
-  std::array<float, UNIT_NUM> elev_angle_;
-  std::array<float, UNIT_NUM> azimuth_offset_;
+  using Engine = DecoderEngine<PandarQTDecoder, Packet, UNIT_NUM>;
+  friend Engine;
+
+  bool parsePacket(const uint8_t* data, size_t size);
+  double packetTime();
+  void convertPacket();
+  double distance(const Unit& unit) const;
+  template <bool Dual>
+  double pointTime(int block_id, int unit_id) const;
+  void convert(const int block_id);
+  template <ReturnMode Mode>
+  void convert_dual(const int block_id);
+  ConvertBlock selectConvert(bool dual_return) const;
 
   std::array<float, UNIT_NUM> firing_offset_;
   std::array<float, BLOCK_NUM> block_offset_single_;
@@ -48,14 +52,6 @@ private:
 
   ReturnMode return_mode_;
   double dual_return_distance_threshold_;
-  Packet packet_;
-
-  PointcloudXYZIRADT scan_pc_;
-  PointcloudXYZIRADT overflow_pc_;
-
-  uint16_t scan_phase_;
-  int last_phase_;
-  bool has_scanned_;
 };
 
 }  // namespace pandar_qt
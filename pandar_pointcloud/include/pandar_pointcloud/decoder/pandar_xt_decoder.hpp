@@ -1,15 +1,14 @@
 #pragma once
 
 #include <array>
-#include "pandar_pointcloud/calibration.hpp"
-#include "packet_decoder.hpp"
+#include "decoder_engine.hpp"
 #include "pandar_xt.hpp"
 
 namespace pandar_pointcloud
 {
 namespace pandar_xt
 {
-class PandarXTDecoder : public PacketDecoder
+class PandarXTDecoder : public DecoderEngine<PandarXTDecoder, Packet, UNIT_NUM>
 {
 public:
   enum class ReturnMode : int8_t
@@ -21,31 +20,24 @@ public:
   };
 
   PandarXTDecoder(Calibration& calibration, float scan_phase = 0.0f, double dual_return_distance_threshold = 0.1, ReturnMode return_mode = ReturnMode::DUAL);
-  void unpack(const pandar_msgs::PandarPacket& raw_packet) override;
-  bool hasScanned() override;
-  PointcloudXYZIRADT getPointcloud() override;
 
 private:
-  bool parsePacket(const pandar_msgs::PandarPacket& raw_packet);
-  PointcloudXYZIRADT convert(const int block_id);
-  PointcloudXYZIRADT convert_dual(const int block_id);
+  using Engine = DecoderEngine<PandarXTDecoder, Packet, UNIT_NUM>;
+  friend Engine;
 
-  std::array<float, UNIT_NUM> elev_angle_;
-  std::array<float, UNIT_NUM> azimuth_offset_;
+  bool parsePacket(const uint8_t* data, size_t size);
+  double packetTime();
+  void convertPacket();
+  double distance(const Unit& unit) const;
+  PointXYZIRADT build_point(int block_id, int unit_id, float block_offset);
+  void convert(const int block_id);
+  void convert_dual(const int block_id);
 
   std::array<float, UNIT_NUM> firing_offset_;
   std::array<float, BLOCK_NUM> block_offset_single_;
   std::array<float, BLOCK_NUM> block_offset_dual_;
 
   ReturnMode return_mode_;
-  Packet packet_;
-
-  PointcloudXYZIRADT scan_pc_;
-  PointcloudXYZIRADT overflow_pc_;
-
-  uint16_t scan_phase_;
-  int last_phase_;
-  bool has_scanned_;
 };
 
 }  // namespace pandar_xt
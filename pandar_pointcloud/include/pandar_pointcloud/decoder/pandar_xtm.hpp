@@ -32,6 +32,8 @@ constexpr size_t PACKET_TAIL_SIZE = 28;
 
 // All
 constexpr size_t PACKET_SIZE = 820;
+// an 820 byte packet carries 6 of the BLOCK_NUM blocks
+constexpr size_t PACKET_BLOCK_NUM = (PACKET_SIZE - HEAD_SIZE - PACKET_TAIL_SIZE) / BLOCK_SIZE;
 
 // 0x33 - First Return      0x39 - Dual Return (Last, Strongest)
 // 0x37 - Strongest Return  0x3B - Dual Return (Last, First)
@@ -44,25 +46,31 @@ constexpr uint32_t DUAL_RETURN = 0x39;
 constexpr uint32_t DUAL_RETURN_B = 0x3b;
 constexpr uint32_t DUAL_RETURN_C = 0x3c;
 constexpr uint32_t TRIPLE_RETURN = 0x3d;
+// 0.18 degree firings at 10 Hz, three returns
+constexpr size_t MAX_POINTS_PER_SCAN = UNIT_NUM * 2000 * 3;
 
+// Wire layout, decoders read these straight from the received datagram.
+#pragma pack(push, 1)
 struct Header
 {
-  uint16_t sob;            // 0xFFEE 2bytes
+  uint16_t sob;            // 0xEE 0xFF on the wire, 0xFFEE read little endian
   int8_t chProtocolMajor;  // Protocol Version Major 1byte
   int8_t chProtocolMinor;  // Protocol Version Minor 1byte
+  uint8_t reserved[2];
   int8_t chLaserNumber;    // laser number 1byte
   int8_t chBlockNumber;    // block number 1byte
   int8_t chReturnType;     // return mode 1 byte  when dual return 0-Single Return
                            // 1-The first block is the 1 st return.
                            // 2-The first block is the 2 nd return
   int8_t chDisUnit;        // Distance unit, 4mm
+  uint8_t reserved_2[2];
 };
 
 struct Unit
 {
-  double distance;
-  uint16_t intensity;
-  uint16_t confidence;
+  uint16_t distance;  // chDisUnit millimeters
+  uint8_t intensity;
+  uint8_t confidence;
 };
 
 struct Block
@@ -71,13 +79,28 @@ struct Block
   Unit units[UNIT_NUM];
 };
 
+struct Tail
+{
+  uint8_t reserved[RESERVED_SIZE];
+  uint8_t return_mode;
+  uint16_t motor_speed;
+  uint8_t date_time[UTC_SIZE];
+  uint32_t timestamp;  // us
+  uint8_t factory_info;
+  uint32_t udp_sequence;
+};
+
 struct Packet
 {
   Header header;
-  Block blocks[BLOCK_NUM];
-  uint32_t usec;  // ms
-  uint32_t return_mode;
-  tm t;
+  Block blocks[PACKET_BLOCK_NUM];
+  Tail tail;
 };
+#pragma pack(pop)
+
+static_assert(sizeof(Header) == HEAD_SIZE, "PandarXTM header layout");
+static_assert(sizeof(Block) == BLOCK_SIZE, "PandarXTM block layout");
+static_assert(sizeof(Tail) == PACKET_TAIL_SIZE, "PandarXTM tail layout");
+static_assert(sizeof(Packet) == PACKET_SIZE, "PandarXTM packet layout");
 }  // namespace pandar_qt
 }  // namespace pandar_pointcloud
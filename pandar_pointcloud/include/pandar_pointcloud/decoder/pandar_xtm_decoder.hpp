@@ -1,8 +1,7 @@
 #pragma once
 
 #include <array>
-#include "pandar_pointcloud/calibration.hpp"
-#include "packet_decoder.hpp"
+#include "decoder_engine.hpp"
 #include "pandar_xtm.hpp"
 
 namespace pandar_pointcloud
@@ -96,7 +95,7 @@ namespace pandar_xtm
 
 const uint16_t MAX_AZIMUTH_DEGREE_NUM=36000;
 
-class PandarXTMDecoder : public PacketDecoder
+class PandarXTMDecoder : public DecoderEngine<PandarXTMDecoder, Packet, UNIT_NUM>
 {
 public:
   enum class ReturnMode : int8_t
@@ -109,41 +108,21 @@ public:
   };
 
   PandarXTMDecoder(Calibration& calibration, float scan_phase = 0.0f, double dual_return_distance_threshold = 0.1, ReturnMode return_mode = ReturnMode::DUAL);
-  void unpack(const pandar_msgs::PandarPacket& raw_packet) override;
-  bool hasScanned() override;
-  PointcloudXYZIRADT getPointcloud() override;
 
 private:
-  bool parsePacket(const pandar_msgs::PandarPacket& raw_packet);
-  PointcloudXYZIRADT convert(const int block_id);
-
-  std::array<float, UNIT_NUM> elev_angle_;
-  std::array<float, UNIT_NUM> azimuth_offset_;
-
-  std::array<float, BLOCK_NUM> block_offset_single_;
-  std::array<float, BLOCK_NUM> block_offset_dual_;
-  std::array<float, BLOCK_NUM> block_offset_triple_;
-
-  std::vector<float> m_sin_elevation_map_;
-  std::vector<float> m_cos_elevation_map_;
-
-  std::vector<float> m_sin_azimuth_map_;
-  std::vector<float> m_cos_azimuth_map_;
-
+  using Engine = DecoderEngine<PandarXTMDecoder, Packet, UNIT_NUM>;
+  friend Engine;
+
+  bool parsePacket(const uint8_t* data, size_t size);
+  double packetTime();
+  void convertPacket();
+  double distance(const Unit& unit) const;
+  void convert_firing(const int block_id);
+  void convert(const int block_id);
+
+  // blocks per firing in packet_
+  size_t firing_returns_ = 1;
   ReturnMode return_mode_;
-  Packet packet_;
-
-  PointcloudXYZIRADT scan_pc_;
-  PointcloudXYZIRADT overflow_pc_;
-
-  uint16_t scan_phase_;
-  int last_phase_;
-  bool has_scanned_;
-  uint16_t last_azimuth_;
-  int start_angle_;
-  double last_timestamp_;
-
-  void CalcXTPointXYZIT(int blockid, char chLaserNumber, boost::shared_ptr<pcl::PointCloud<PointXYZIRADT>> cld);
 };
 
 }  // namespace pandar_xt
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+namespace pandar_pointcloud
+{
+// sin/cos for every 0.01 degree of azimuth, the resolution of the packet azimuth field.
+// Built once on first use and shared by all decoders.
+class TrigTable
+{
+public:
+  static constexpr int STEPS = 36000;
+
+  static const TrigTable& instance();
+
+  // azimuth in 0.01 degrees, wrapped into [0, 360)
+  float sin(int azimuth) const { return sin_[wrap(azimuth)]; }
+  float cos(int azimuth) const { return cos_[wrap(azimuth)]; }
+  // raw tables for vectorised lookups, STEPS entries each
+  const float* sinData() const { return sin_.data(); }
+  const float* cosData() const { return cos_.data(); }
+
+  static int wrap(int azimuth)
+  {
+    azimuth %= STEPS;
+    return azimuth < 0 ? azimuth + STEPS : azimuth;
+  }
+  // a calibrated angle in degrees, rounded to table steps
+  static int toSteps(float degrees) { return static_cast<int>(std::lround(degrees * 100.0f)); }
+
+private:
+  TrigTable();
+
+  std::vector<float> sin_;
+  std::vector<float> cos_;
+};
+}  // namespace pandar_pointcloud
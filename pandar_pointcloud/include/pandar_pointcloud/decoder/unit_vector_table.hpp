@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "trig_table.hpp"
+
+namespace pandar_pointcloud
+{
+// Direction of every (channel, azimuth step) with the calibrated elevation and azimuth offset folded in,
+// so a point is distance * vector. Large (channels * 360 / resolution * 12 bytes), hence optional.
+class UnitVectorTable
+{
+public:
+  struct Vector
+  {
+    float x;
+    float y;
+    float z;
+  };
+
+  // elev_angle and azimuth_offset in degrees, resolution in degrees (a multiple of 0.01)
+  UnitVectorTable(const float* elev_angle, const float* azimuth_offset, size_t channels, double resolution);
+
+  // azimuth in 0.01 degrees as in the packet, rounded to the nearest step
+  const Vector& at(size_t channel, int azimuth) const
+  {
+    int step = (TrigTable::wrap(azimuth) + half_step_) / step_size_;
+    if (step == steps_) {
+      step = 0;
+    }
+    return vectors_[channel * steps_ + step];
+  }
+
+  size_t bytes() const { return vectors_.size() * sizeof(Vector); }
+
+private:
+  int step_size_;
+  int half_step_;
+  int steps_;
+  std::vector<Vector> vectors_;
+};
+}  // namespace pandar_pointcloud
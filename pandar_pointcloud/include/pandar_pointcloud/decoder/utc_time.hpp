@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace pandar_pointcloud
+{
+// Seconds since 1970-01-01 for a UTC date and time, without timegm's timezone handling.
+// Days from the civil date as in Howard Hinnant's days_from_civil, restricted to years >= 0.
+inline int64_t utcToEpoch(int year, int month, int day, int hour, int minute, int second)
+{
+  const int shifted = month <= 2;
+  year -= shifted;
+  const int era = year / 400;
+  const int yoe = year - era * 400;
+  const int doy = (153 * (month + 12 * shifted - 3) + 2) / 5 + day - 1;
+  const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  const int64_t days = static_cast<int64_t>(era) * 146097 + doe - 719468;
+  return days * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+// Epoch of the 6-byte date-time field (year, month, day, hour, minute, second) of a Pandar packet.
+// The field only changes once a second, so the conversion is cached on its raw bytes.
+class UtcEpochCache
+{
+public:
+  UtcEpochCache() : key_(~0ull), epoch_(0) {}
+
+  int64_t epoch(const uint8_t* utc)
+  {
+    uint64_t key = 0;
+    std::memcpy(&key, utc, 6);
+    if (key != key_) {
+      key_ = key;
+      // years since 2000, or since 1900 from sensors reporting tm_year
+      const int year = utc[0] + (utc[0] >= 100 ? 1900 : 2000);
+      epoch_ = utcToEpoch(year, utc[1], utc[2], utc[3], utc[4], utc[5]);
+    }
+    return epoch_;
+  }
+
+private:
+  uint64_t key_;
+  int64_t epoch_;
+};
+}  // namespace pandar_pointcloud
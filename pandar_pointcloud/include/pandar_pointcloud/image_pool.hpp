@@ -0,0 +1,33 @@
+#pragma once
+
+#include <sensor_msgs/Image.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pandar_pointcloud
+{
+// Recycles range and intensity images like CloudPool does scan clouds: an image comes back when its last
+// reference is dropped and keeps its data buffer, so once warm a scan's image of the same size is filled
+// without allocating. Keep one pool per kind of image so the buffers match in size.
+class ImagePool : public std::enable_shared_from_this<ImagePool>
+{
+public:
+  static std::shared_ptr<ImagePool> create(size_t max_idle = 4);
+  ~ImagePool();
+
+  // An image of height rows of width pixels of pixel_size bytes. The pixels are left as they were, the
+  // caller fills them.
+  sensor_msgs::ImagePtr acquire(uint32_t height, uint32_t width, const std::string& encoding, size_t pixel_size);
+
+private:
+  explicit ImagePool(size_t max_idle);
+  void release(sensor_msgs::Image* image);
+
+  size_t max_idle_;
+
+  std::mutex mutex_;
+  std::vector<sensor_msgs::Image*> idle_;
+};
+}  // namespace pandar_pointcloud
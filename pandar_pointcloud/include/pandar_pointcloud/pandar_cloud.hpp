@@ -2,14 +2,21 @@
 
 #include <ros/ros.h>
 #include <pandar_msgs/PandarScan.h>
+#include <pandar_msgs/PandarCompactScan.h>
+#include <pandar_msgs/PandarSectorCloud.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <diagnostic_updater/diagnostic_updater.h>
 #include <pandar_api/tcp_client.hpp>
 #include "pandar_pointcloud/calibration.hpp"
+#include "pandar_pointcloud/cloud_writer.hpp"
+#include "pandar_pointcloud/decode_pool.hpp"
 #include "pandar_pointcloud/decoder/packet_decoder.hpp"
+#include "pandar_pointcloud/pipeline.hpp"
 // #include "pandar_pointcloud/tcp_command_client.hpp"
 
 
 #include <string>
+#include <thread>
 
 namespace pandar_pointcloud
 {
@@ -20,9 +27,45 @@ public:
   ~PandarCloud();
 
 private:
+  // pipeline items: a scan message waiting for the decode stage, a completed scan for the conversion and
+  // publish stages
+  struct ScanJob
+  {
+    pandar_msgs::PandarScan::ConstPtr scan;
+    pandar_msgs::PandarCompactScan::ConstPtr compact_scan;
+    StageLatency::Clock::time_point queued;
+  };
+  struct CloudJob
+  {
+    PointcloudXYZIRADT cloud;
+    sensor_msgs::PointCloud2Ptr points_ex;
+    sensor_msgs::PointCloud2Ptr points;
+    sensor_msgs::ImagePtr range_image;
+    sensor_msgs::ImagePtr intensity_image;
+    StageLatency::Clock::time_point received;  // the scan message that completed the cloud
+    StageLatency::Clock::time_point queued;
+  };
+
   bool setupCalibration();
+  void startPipeline(size_t queue_size, OverflowPolicy policy);
+  void decodeLoop();
+  void convertLoop();
+  void publishLoop();
+  void checkPipeline(diagnostic_updater::DiagnosticStatusWrapper& stat);
   void onProcessScan(const pandar_msgs::PandarScan::ConstPtr& msg);
-  pcl::PointCloud<PointXYZIR>::Ptr convertPointcloud(const pcl::PointCloud<PointXYZIRADT>::ConstPtr& input_pointcloud);
+  void onProcessCompactScan(const pandar_msgs::PandarCompactScan::ConstPtr& msg);
+  void processScan(const pandar_msgs::PandarScan::ConstPtr& msg);
+  void processCompactScan(const pandar_msgs::PandarCompactScan::ConstPtr& msg);
+  void decodePackets(const std::string& frame_id, uint16_t sector_count);
+  void onPacketDecoded(const std::string& frame_id, uint16_t sector_count);
+  void publishPointcloud(const std::string& frame_id);
+  void serializeScan(CloudJob& job);
+  void publishScan(const CloudJob& job);
+  void checkCloudPool(diagnostic_updater::DiagnosticStatusWrapper& stat);
+  void beginSector(uint16_t sector_count);
+  void collectSector();
+  void appendSectorPoints(const pcl::PointCloud<PointXYZIRADT>& source);
+  void publishSector(const std_msgs::Header& header, uint16_t sector_index, uint16_t sector_count);
 
   std::string model_;
   std::string return_mode_;
@@ -30,14 +73,48 @@ private:
   std::string calibration_path_;
   double dual_return_distance_threshold_;
   double scan_phase_;
+  bool compact_scan_;
+  double unit_vector_resolution_;
+  int decode_threads_;
+  double organized_resolution_;
+  double image_resolution_;
+  bool pipeline_;
 
   ros::Subscriber pandar_packet_sub_;
   ros::Publisher pandar_points_pub_;
   ros::Publisher pandar_points_ex_pub_;
+  ros::Publisher pandar_sector_points_pub_;
+  ros::Publisher pandar_range_image_pub_;
+  ros::Publisher pandar_intensity_image_pub_;
 
   std::shared_ptr<PacketDecoder> decoder_;
+  std::shared_ptr<CloudWriter> cloud_writer_;
+  // packets of the message being processed, decoded in slices by decode_pool_ when decode_threads > 1
+  std::vector<DecodePool::Packet> packets_;
+  std::unique_ptr<DecodePool> decode_pool_;
   std::shared_ptr<pandar_api::TCPClient> tcp_client_;
+  diagnostic_updater::Updater updater_;
   Calibration calibration_;
+
+  // sector streaming: the decoder cloud being followed and how many of its points were already sent
+  PointcloudXYZIRADT sector_source_;
+  size_t sector_published_;
+  PointcloudXYZIRADT sector_pc_;
+
+  // with pipeline set, scan messages are decoded, converted and published on three threads joined by
+  // bounded queues, so a rotation is decoded while the previous one is still being converted or published
+  std::unique_ptr<BoundedQueue<ScanJob>> scan_queue_;
+  std::unique_ptr<BoundedQueue<CloudJob>> convert_queue_;
+  std::unique_ptr<BoundedQueue<CloudJob>> publish_queue_;
+  std::thread decode_thread_;
+  std::thread convert_thread_;
+  std::thread publish_thread_;
+  StageLatency::Clock::time_point received_;
+  StageLatency decode_latency_;
+  StageLatency convert_latency_;
+  StageLatency publish_latency_;
+  StageLatency total_latency_;
+  uint64_t reported_pipeline_drops_;
 };
 
 }  // namespace pandar_pointcloud
\ No newline at end of file
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+namespace pandar_pointcloud
+{
+// What a full BoundedQueue does with a new item: discard the oldest queued one, or wait for room.
+enum class OverflowPolicy
+{
+  DROP_OLDEST,
+  BLOCK
+};
+
+// Hands items from one pipeline stage thread to the next. Once closed, push() and pop() return false
+// straight away, waking any stage blocked on the queue.
+template <class T>
+class BoundedQueue
+{
+public:
+  struct Stats
+  {
+    uint64_t pushed;
+    uint64_t dropped;  // discarded by DROP_OLDEST
+    size_t size;
+    size_t high_water;
+  };
+
+  BoundedQueue(size_t capacity, OverflowPolicy policy)
+    : capacity_(std::max<size_t>(capacity, 1)), policy_(policy), closed_(false), stats_{ 0, 0, 0, 0 }
+  {
+  }
+
+  bool push(T item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (policy_ == OverflowPolicy::BLOCK) {
+      not_full_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+    }
+    else if (items_.size() == capacity_) {
+      items_.pop_front();
+      ++stats_.dropped;
+    }
+    if (closed_) {
+      return false;
+    }
+    items_.push_back(std::move(item));
+    ++stats_.pushed;
+    stats_.high_water = std::max(stats_.high_water, items_.size());
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  bool pop(T& item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+    if (closed_) {
+      return false;
+    }
+    item = std::move(items_.front());
+    items_.pop_front();
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+      items_.clear();
+    }
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+  Stats stats() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.size = items_.size();
+    return stats;
+  }
+
+private:
+  const size_t capacity_;
+  const OverflowPolicy policy_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::deque<T> items_;
+  bool closed_;
+  Stats stats_;
+};
+
+// Latency of one pipeline stage, from the item entering its queue to the stage finishing with it.
+// take() summarises the items since the previous take(), one diagnostics period.
+class StageLatency
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Summary
+  {
+    uint64_t count;
+    double mean_ms;
+    double max_ms;
+  };
+
+  void add(Clock::time_point queued)
+  {
+    const double ms = std::chrono::duration<double, std::milli>(Clock::now() - queued).count();
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++count_;
+    sum_ms_ += ms;
+    max_ms_ = std::max(max_ms_, ms);
+  }
+
+  Summary take()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Summary summary{ count_, count_ > 0 ? sum_ms_ / count_ : 0.0, max_ms_ };
+    count_ = 0;
+    sum_ms_ = 0.0;
+    max_ms_ = 0.0;
+    return summary;
+  }
+
+private:
+  std::mutex mutex_;
+  uint64_t count_ = 0;
+  double sum_ms_ = 0.0;
+  double max_ms_ = 0.0;
+};
+}  // namespace pandar_pointcloud
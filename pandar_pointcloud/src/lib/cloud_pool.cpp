@@ -0,0 +1,75 @@
+#include "pandar_pointcloud/cloud_pool.hpp"
+
+namespace pandar_pointcloud
+{
+std::shared_ptr<CloudPool> CloudPool::create(size_t reserve_points, size_t max_idle)
+{
+  return std::shared_ptr<CloudPool>(new CloudPool(reserve_points, max_idle));
+}
+
+CloudPool::CloudPool(size_t reserve_points, size_t max_idle)
+  : reserve_points_(reserve_points), max_idle_(max_idle), stats_{ 0, 0, 0, 0 }
+{
+  idle_.reserve(max_idle_);
+}
+
+CloudPool::~CloudPool()
+{
+  for (auto cloud : idle_) {
+    delete cloud;
+  }
+}
+
+PointcloudXYZIRADT CloudPool::acquire()
+{
+  pcl::PointCloud<PointXYZIRADT>* cloud = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!idle_.empty()) {
+      cloud = idle_.back();
+      idle_.pop_back();
+      ++stats_.hits;
+    }
+    else {
+      ++stats_.misses;
+    }
+  }
+  if (cloud == nullptr) {
+    cloud = new pcl::PointCloud<PointXYZIRADT>;
+    cloud->reserve(reserve_points_);
+  }
+
+  // the pool may be gone by the time a subscriber drops the last reference
+  std::weak_ptr<CloudPool> pool = shared_from_this();
+  return PointcloudXYZIRADT(cloud, [pool](pcl::PointCloud<PointXYZIRADT>* cloud) {
+    if (auto owner = pool.lock()) {
+      owner->release(cloud);
+    }
+    else {
+      delete cloud;
+    }
+  });
+}
+
+void CloudPool::release(pcl::PointCloud<PointXYZIRADT>* cloud)
+{
+  cloud->clear();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_.size() < max_idle_) {
+      idle_.push_back(cloud);
+      return;
+    }
+    ++stats_.discarded;
+  }
+  delete cloud;
+}
+
+CloudPool::Stats CloudPool::stats() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats = stats_;
+  stats.idle = idle_.size();
+  return stats;
+}
+}  // namespace pandar_pointcloud
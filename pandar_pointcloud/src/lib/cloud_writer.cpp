@@ -0,0 +1,155 @@
+#include "pandar_pointcloud/cloud_writer.hpp"
+#include <pcl_conversions/pcl_conversions.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace pandar_pointcloud
+{
+namespace
+{
+sensor_msgs::PointField makeField(const std::string& name, size_t offset, uint8_t datatype)
+{
+  sensor_msgs::PointField field;
+  field.name = name;
+  field.offset = offset;
+  field.datatype = datatype;
+  field.count = 1;
+  return field;
+}
+
+template <bool Ex, bool Points>
+void writePoints(const pcl::PointCloud<PointXYZIRADT>::VectorType& points, uint8_t* ex_data, uint8_t* points_data)
+{
+  PointXYZIR point;
+  std::memset(&point, 0, sizeof(point));
+  for (size_t i = 0; i < points.size(); ++i) {
+    const PointXYZIRADT& p = points[i];
+    if (Ex) {
+      std::memcpy(ex_data + i * sizeof(PointXYZIRADT), &p, sizeof(PointXYZIRADT));
+    }
+    if (Points) {
+      point.x = p.x;
+      point.y = p.y;
+      point.z = p.z;
+      point.intensity = p.intensity;
+      point.ring = p.ring;
+      std::memcpy(points_data + i * sizeof(PointXYZIR), &point, sizeof(PointXYZIR));
+    }
+  }
+}
+}  // namespace
+
+std::shared_ptr<CloudWriter> CloudWriter::create(size_t max_idle)
+{
+  return std::shared_ptr<CloudWriter>(new CloudWriter(max_idle));
+}
+
+CloudWriter::CloudWriter(size_t max_idle) : max_idle_(max_idle)
+{
+  using sensor_msgs::PointField;
+  fields_[XYZIRADT] = {
+    makeField("x", offsetof(PointXYZIRADT, x), PointField::FLOAT32),
+    makeField("y", offsetof(PointXYZIRADT, y), PointField::FLOAT32),
+    makeField("z", offsetof(PointXYZIRADT, z), PointField::FLOAT32),
+    makeField("intensity", offsetof(PointXYZIRADT, intensity), PointField::FLOAT32),
+    makeField("ring", offsetof(PointXYZIRADT, ring), PointField::UINT16),
+    makeField("azimuth", offsetof(PointXYZIRADT, azimuth), PointField::FLOAT32),
+    makeField("distance", offsetof(PointXYZIRADT, distance), PointField::FLOAT32),
+    makeField("return_type", offsetof(PointXYZIRADT, return_type), PointField::UINT8),
+    makeField("time_stamp", offsetof(PointXYZIRADT, time_stamp), PointField::FLOAT64),
+  };
+  fields_[XYZIR] = {
+    makeField("x", offsetof(PointXYZIR, x), PointField::FLOAT32),
+    makeField("y", offsetof(PointXYZIR, y), PointField::FLOAT32),
+    makeField("z", offsetof(PointXYZIR, z), PointField::FLOAT32),
+    makeField("intensity", offsetof(PointXYZIR, intensity), PointField::FLOAT32),
+    makeField("ring", offsetof(PointXYZIR, ring), PointField::UINT16),
+  };
+  point_step_[XYZIRADT] = sizeof(PointXYZIRADT);
+  point_step_[XYZIR] = sizeof(PointXYZIR);
+}
+
+CloudWriter::~CloudWriter()
+{
+  for (auto& idle : idle_) {
+    for (auto msg : idle) {
+      delete msg;
+    }
+  }
+}
+
+void CloudWriter::write(const pcl::PointCloud<PointXYZIRADT>& cloud, sensor_msgs::PointCloud2Ptr* points_ex,
+                        sensor_msgs::PointCloud2Ptr* points)
+{
+  uint8_t* ex_data = nullptr;
+  uint8_t* points_data = nullptr;
+  if (points_ex) {
+    *points_ex = acquire(XYZIRADT, cloud);
+    ex_data = (*points_ex)->data.data();
+  }
+  if (points) {
+    *points = acquire(XYZIR, cloud);
+    points_data = (*points)->data.data();
+  }
+
+  if (ex_data && points_data) {
+    writePoints<true, true>(cloud.points, ex_data, points_data);
+  }
+  else if (ex_data) {
+    writePoints<true, false>(cloud.points, ex_data, points_data);
+  }
+  else if (points_data) {
+    writePoints<false, true>(cloud.points, ex_data, points_data);
+  }
+}
+
+sensor_msgs::PointCloud2Ptr CloudWriter::acquire(Layout layout, const pcl::PointCloud<PointXYZIRADT>& cloud)
+{
+  sensor_msgs::PointCloud2* msg = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!idle_[layout].empty()) {
+      msg = idle_[layout].back();
+      idle_[layout].pop_back();
+    }
+  }
+  if (msg == nullptr) {
+    msg = new sensor_msgs::PointCloud2;
+    msg->fields = fields_[layout];
+    msg->point_step = point_step_[layout];
+    msg->is_bigendian = false;
+  }
+
+  pcl_conversions::fromPCL(cloud.header, msg->header);
+  msg->height = std::max<uint32_t>(cloud.height, 1);
+  msg->width = cloud.points.size() / msg->height;
+  msg->is_dense = cloud.is_dense;
+  msg->row_step = msg->point_step * msg->width;
+  // a recycled buffer of the same size is not touched again
+  msg->data.resize(msg->point_step * cloud.points.size());
+
+  // the writer may be gone by the time a subscriber drops the last reference
+  std::weak_ptr<CloudWriter> writer = shared_from_this();
+  return sensor_msgs::PointCloud2Ptr(msg, [writer, layout](sensor_msgs::PointCloud2* msg) {
+    if (auto owner = writer.lock()) {
+      owner->release(layout, msg);
+    }
+    else {
+      delete msg;
+    }
+  });
+}
+
+void CloudWriter::release(Layout layout, sensor_msgs::PointCloud2* msg)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_[layout].size() < max_idle_) {
+      idle_[layout].push_back(msg);
+      return;
+    }
+  }
+  delete msg;
+}
+}  // namespace pandar_pointcloud
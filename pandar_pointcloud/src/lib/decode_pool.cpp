@@ -0,0 +1,103 @@
+#include "pandar_pointcloud/decode_pool.hpp"
+#include <algorithm>
+
+namespace
+{
+const size_t MIN_PACKETS_PER_SLICE = 16;
+}  // namespace
+
+namespace pandar_pointcloud
+{
+DecodePool::DecodePool(const PacketDecoder& decoder, size_t threads)
+  : slices_(std::max<size_t>(threads, 1)), packets_(nullptr), slice_count_(0), pending_(0), generation_(0),
+    stop_(false)
+{
+  for (size_t i = 0; i < slices_.size(); ++i) {
+    decoders_.push_back(decoder.clone());
+  }
+  // slice 0 is decoded by the caller
+  for (size_t i = 1; i < slices_.size(); ++i) {
+    threads_.emplace_back(&DecodePool::run, this, i);
+  }
+}
+
+DecodePool::~DecodePool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+size_t DecodePool::decode(const std::vector<Packet>& packets)
+{
+  const size_t slice_count =
+      std::max<size_t>(1, std::min(slices_.size(), packets.size() / MIN_PACKETS_PER_SLICE));
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    packets_ = &packets;
+    slice_count_ = slice_count;
+    pending_ = slice_count - 1;
+    ++generation_;
+  }
+  if (slice_count > 1) {
+    start_.notify_all();
+  }
+
+  decodeSlice(0);
+
+  if (slice_count > 1) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+  }
+  return slice_count;
+}
+
+void DecodePool::setComputeXYZ(bool compute_xyz)
+{
+  for (auto& decoder : decoders_) {
+    decoder->setComputeXYZ(compute_xyz);
+  }
+}
+
+void DecodePool::run(size_t index)
+{
+  uint64_t generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_.wait(lock, [this, generation] { return stop_ || generation_ != generation; });
+      if (stop_) {
+        return;
+      }
+      generation = generation_;
+      if (index >= slice_count_) {
+        continue;
+      }
+    }
+    decodeSlice(index);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--pending_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+}
+
+void DecodePool::decodeSlice(size_t index)
+{
+  const std::vector<Packet>& packets = *packets_;
+  const size_t begin = packets.size() * index / slice_count_;
+  const size_t end = packets.size() * (index + 1) / slice_count_;
+  PacketDecoder::Slice& slice = slices_[index];
+  slice.clear();
+  for (size_t i = begin; i < end; ++i) {
+    decoders_[index]->unpackSlice(packets[i].data, packets[i].size, slice);
+  }
+}
+}  // namespace pandar_pointcloud
@@ -0,0 +1,280 @@
+#include "pandar_pointcloud/decoder/block_kernel.hpp"
+#include "pandar_pointcloud/decoder/trig_table.hpp"
+#include <ros/ros.h>
+#include <cstring>
+#include <random>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PANDAR_BLOCK_KERNEL_X86
+#endif
+
+namespace pandar_pointcloud
+{
+namespace
+{
+inline uint16_t loadDistance(const uint8_t* record)
+{
+  uint16_t raw;
+  std::memcpy(&raw, record, sizeof(raw));
+  return raw;
+}
+
+// The vector kernels below must perform exactly these float operations, in this order.
+size_t convertScalar(const uint8_t* records, size_t stride, size_t channels, int azimuth,
+                     const BlockKernelParams& params, const BlockKernelTables& tables, BlockKernelOutput& out)
+{
+  const float* sin_table = TrigTable::instance().sinData();
+  const float* cos_table = TrigTable::instance().cosData();
+  azimuth = TrigTable::wrap(azimuth);
+
+  size_t count = 0;
+  for (size_t channel = 0; channel < channels; ++channel) {
+    const float distance = static_cast<float>(loadDistance(records + channel * stride)) * params.distance_unit;
+    const float xy_distance = distance * tables.cos_elev[channel];
+    const float range = params.horizontal_range ? xy_distance : distance;
+    if (!(range >= params.min_range && range <= params.max_range)) {
+      continue;
+    }
+    int step = azimuth + tables.azimuth_offset[channel];
+    if (step >= TrigTable::STEPS) {
+      step -= TrigTable::STEPS;
+    }
+    out.x[count] = xy_distance * sin_table[step];
+    out.y[count] = xy_distance * cos_table[step];
+    out.z[count] = distance * tables.sin_elev[channel];
+    out.distance[count] = distance;
+    out.channel[count] = static_cast<int32_t>(channel);
+    ++count;
+  }
+  return count;
+}
+
+#ifdef PANDAR_BLOCK_KERNEL_X86
+// lane permutations moving the set lanes of a mask to the front
+struct CompactTables
+{
+  CompactTables()
+  {
+    for (int mask = 0; mask < 256; ++mask) {
+      int lane = 0;
+      for (int i = 0; i < 8; ++i) {
+        if (mask & (1 << i)) {
+          lanes8[mask][lane++] = i;
+        }
+      }
+      for (; lane < 8; ++lane) {
+        lanes8[mask][lane] = 0;
+      }
+    }
+    for (int mask = 0; mask < 16; ++mask) {
+      int lane = 0;
+      for (int i = 0; i < 4; ++i) {
+        if (mask & (1 << i)) {
+          for (int b = 0; b < 4; ++b) {
+            bytes4[mask][lane * 4 + b] = static_cast<uint8_t>(i * 4 + b);
+          }
+          ++lane;
+        }
+      }
+      for (; lane < 4; ++lane) {
+        for (int b = 0; b < 4; ++b) {
+          bytes4[mask][lane * 4 + b] = 0x80;
+        }
+      }
+    }
+  }
+  alignas(32) int32_t lanes8[256][8];
+  alignas(16) uint8_t bytes4[16][16];
+};
+
+const CompactTables& compactTables()
+{
+  static const CompactTables tables;
+  return tables;
+}
+
+__attribute__((target("avx2"))) size_t convertAvx2(const uint8_t* records, size_t stride, size_t channels,
+                                                   int azimuth, const BlockKernelParams& params,
+                                                   const BlockKernelTables& tables, BlockKernelOutput& out)
+{
+  const float* sin_table = TrigTable::instance().sinData();
+  const float* cos_table = TrigTable::instance().cosData();
+  const auto& lanes = compactTables().lanes8;
+
+  const __m256 unit = _mm256_set1_ps(params.distance_unit);
+  const __m256 min_range = _mm256_set1_ps(params.min_range);
+  const __m256 max_range = _mm256_set1_ps(params.max_range);
+  const __m256i base = _mm256_set1_epi32(TrigTable::wrap(azimuth));
+  const __m256i steps = _mm256_set1_epi32(TrigTable::STEPS);
+  const __m256i last_step = _mm256_set1_epi32(TrigTable::STEPS - 1);
+  __m256i channel = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i channel_stride = _mm256_set1_epi32(8);
+  // byte offsets of 8 consecutive records, the gather reads 4 bytes and the low 2 are the distance
+  const __m256i record_offset = _mm256_mullo_epi32(channel, _mm256_set1_epi32(static_cast<int>(stride)));
+  const __m256i distance_mask = _mm256_set1_epi32(0xffff);
+
+  size_t count = 0;
+  for (size_t c = 0; c < channels; c += 8, channel = _mm256_add_epi32(channel, channel_stride)) {
+    const __m256i raw = _mm256_and_si256(
+        _mm256_i32gather_epi32(reinterpret_cast<const int*>(records + c * stride), record_offset, 1), distance_mask);
+    const __m256 distance = _mm256_mul_ps(_mm256_cvtepi32_ps(raw), unit);
+    const __m256 xy_distance = _mm256_mul_ps(distance, _mm256_loadu_ps(&tables.cos_elev[c]));
+    const __m256 range = params.horizontal_range ? xy_distance : distance;
+    const __m256 valid =
+        _mm256_and_ps(_mm256_cmp_ps(range, min_range, _CMP_GE_OQ), _mm256_cmp_ps(range, max_range, _CMP_LE_OQ));
+    const int mask = _mm256_movemask_ps(valid);
+    if (mask == 0) {
+      continue;
+    }
+
+    __m256i step =
+        _mm256_add_epi32(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&tables.azimuth_offset[c])));
+    step = _mm256_sub_epi32(step, _mm256_and_si256(_mm256_cmpgt_epi32(step, last_step), steps));
+    const __m256 x = _mm256_mul_ps(xy_distance, _mm256_i32gather_ps(sin_table, step, 4));
+    const __m256 y = _mm256_mul_ps(xy_distance, _mm256_i32gather_ps(cos_table, step, 4));
+    const __m256 z = _mm256_mul_ps(distance, _mm256_loadu_ps(&tables.sin_elev[c]));
+
+    const __m256i perm = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes[mask]));
+    _mm256_storeu_ps(out.x + count, _mm256_permutevar8x32_ps(x, perm));
+    _mm256_storeu_ps(out.y + count, _mm256_permutevar8x32_ps(y, perm));
+    _mm256_storeu_ps(out.z + count, _mm256_permutevar8x32_ps(z, perm));
+    _mm256_storeu_ps(out.distance + count, _mm256_permutevar8x32_ps(distance, perm));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.channel + count), _mm256_permutevar8x32_epi32(channel, perm));
+    count += __builtin_popcount(mask);
+  }
+  return count;
+}
+
+__attribute__((target("sse4.1"))) size_t convertSse41(const uint8_t* records, size_t stride, size_t channels,
+                                                      int azimuth, const BlockKernelParams& params,
+                                                      const BlockKernelTables& tables, BlockKernelOutput& out)
+{
+  const float* sin_table = TrigTable::instance().sinData();
+  const float* cos_table = TrigTable::instance().cosData();
+  const auto& bytes = compactTables().bytes4;
+
+  const __m128 unit = _mm_set1_ps(params.distance_unit);
+  const __m128 min_range = _mm_set1_ps(params.min_range);
+  const __m128 max_range = _mm_set1_ps(params.max_range);
+  const __m128i base = _mm_set1_epi32(TrigTable::wrap(azimuth));
+  const __m128i steps = _mm_set1_epi32(TrigTable::STEPS);
+  const __m128i last_step = _mm_set1_epi32(TrigTable::STEPS - 1);
+  __m128i channel = _mm_setr_epi32(0, 1, 2, 3);
+  const __m128i channel_stride = _mm_set1_epi32(4);
+
+  size_t count = 0;
+  for (size_t c = 0; c < channels; c += 4, channel = _mm_add_epi32(channel, channel_stride)) {
+    const uint8_t* record = records + c * stride;
+    const __m128i raw = _mm_setr_epi32(loadDistance(record), loadDistance(record + stride),
+                                       loadDistance(record + 2 * stride), loadDistance(record + 3 * stride));
+    const __m128 distance = _mm_mul_ps(_mm_cvtepi32_ps(raw), unit);
+    const __m128 xy_distance = _mm_mul_ps(distance, _mm_loadu_ps(&tables.cos_elev[c]));
+    const __m128 range = params.horizontal_range ? xy_distance : distance;
+    const __m128 valid = _mm_and_ps(_mm_cmpge_ps(range, min_range), _mm_cmple_ps(range, max_range));
+    const int mask = _mm_movemask_ps(valid);
+    if (mask == 0) {
+      continue;
+    }
+
+    __m128i step = _mm_add_epi32(base, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&tables.azimuth_offset[c])));
+    step = _mm_sub_epi32(step, _mm_and_si128(_mm_cmpgt_epi32(step, last_step), steps));
+    alignas(16) int32_t index[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(index), step);
+    const __m128 sin_azimuth =
+        _mm_setr_ps(sin_table[index[0]], sin_table[index[1]], sin_table[index[2]], sin_table[index[3]]);
+    const __m128 cos_azimuth =
+        _mm_setr_ps(cos_table[index[0]], cos_table[index[1]], cos_table[index[2]], cos_table[index[3]]);
+    const __m128 x = _mm_mul_ps(xy_distance, sin_azimuth);
+    const __m128 y = _mm_mul_ps(xy_distance, cos_azimuth);
+    const __m128 z = _mm_mul_ps(distance, _mm_loadu_ps(&tables.sin_elev[c]));
+
+    const __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(bytes[mask]));
+    _mm_storeu_ps(out.x + count, _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(x), shuffle)));
+    _mm_storeu_ps(out.y + count, _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(y), shuffle)));
+    _mm_storeu_ps(out.z + count, _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(z), shuffle)));
+    _mm_storeu_ps(out.distance + count, _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(distance), shuffle)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out.channel + count), _mm_shuffle_epi8(channel, shuffle));
+    count += __builtin_popcount(mask);
+  }
+  return count;
+}
+#endif
+}  // namespace
+
+const BlockKernel& BlockKernel::instance()
+{
+  static const BlockKernel kernel;
+  return kernel;
+}
+
+BlockKernel::BlockKernel() : function_(&convertScalar), name_("scalar")
+{
+  const std::vector<Variant> candidates = variants();
+  for (auto variant = candidates.rbegin(); variant != candidates.rend(); ++variant) {
+    if (variant->function == &convertScalar || selfCheck(variant->function)) {
+      function_ = variant->function;
+      name_ = variant->name;
+      break;
+    }
+  }
+  ROS_INFO("Block kernel: %s", name_);
+}
+
+std::vector<BlockKernel::Variant> BlockKernel::variants()
+{
+  std::vector<Variant> variants{ { "scalar", &convertScalar } };
+#ifdef PANDAR_BLOCK_KERNEL_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.1")) {
+    variants.push_back({ "sse4.1", &convertSse41 });
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    variants.push_back({ "avx2", &convertAvx2 });
+  }
+#endif
+  return variants;
+}
+
+bool BlockKernel::selfCheck(Function function)
+{
+  std::mt19937 random(128);
+  std::uniform_real_distribution<float> elevation(-60.0f, 60.0f);
+  std::uniform_int_distribution<int> offset(-1200, 1200);
+  std::uniform_int_distribution<int> raw(0, 0xffff);
+
+  BlockKernelTables tables;
+  for (size_t channel = 0; channel < BLOCK_KERNEL_CHANNELS; ++channel) {
+    const float elev = elevation(random) * static_cast<float>(M_PI / 180.0);
+    tables.cos_elev[channel] = cosf(elev);
+    tables.sin_elev[channel] = sinf(elev);
+    tables.azimuth_offset[channel] = TrigTable::wrap(offset(random));
+  }
+
+  BlockKernelOutput expected;
+  BlockKernelOutput actual;
+  // records 3 bytes (Pandar40, 64, 128E4X) and 4 bytes (QT, XT, QT128) apart, noise in between
+  uint8_t records[BLOCK_KERNEL_CHANNELS * 4 + 2];
+  for (int azimuth = 0; azimuth < 0x10000; azimuth += 97) {
+    for (auto& byte : records) {
+      byte = static_cast<uint8_t>(raw(random));
+    }
+    const size_t stride = 3 + azimuth % 2;
+    const size_t channels = BLOCK_KERNEL_CHANNELS - (azimuth % 3) * 32;
+    for (bool horizontal_range : { false, true }) {
+      const BlockKernelParams params{ 0.004f, 0.1f, 200.0f, horizontal_range };
+      const size_t count = convertScalar(records, stride, channels, azimuth, params, tables, expected);
+      if (function(records, stride, channels, azimuth, params, tables, actual) != count) {
+        return false;
+      }
+      const size_t bytes = count * sizeof(float);
+      if (std::memcmp(expected.x, actual.x, bytes) != 0 || std::memcmp(expected.y, actual.y, bytes) != 0 ||
+          std::memcmp(expected.z, actual.z, bytes) != 0 || std::memcmp(expected.distance, actual.distance, bytes) != 0 ||
+          std::memcmp(expected.channel, actual.channel, count * sizeof(int32_t)) != 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+}  // namespace pandar_pointcloud
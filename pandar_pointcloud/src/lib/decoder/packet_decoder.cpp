@@ -0,0 +1,181 @@
+#include "pandar_pointcloud/decoder/packet_decoder.hpp"
+#include <cmath>
+#include <limits>
+
+namespace pandar_pointcloud
+{
+PacketDecoder::PacketDecoder(size_t channels, size_t max_points, float scan_phase)
+  : cloud_pool_(CloudPool::create(max_points)), channels_(channels),
+    scan_phase_(static_cast<uint16_t>(scan_phase * 100.0f)), last_phase_(0), has_scanned_(false), scan_split_(0),
+    slice_(nullptr), grid_columns_(0), grid_returns_(1), grid_column_(0), range_image_pool_(ImagePool::create()),
+    intensity_image_pool_(ImagePool::create()), image_columns_(0), image_column_(0), range_encoding_(RangeImageEncoding::FLOAT_METERS), range_ticks_per_meter_(0.0f), compute_xyz_(true)
+{
+  buffer_pc_ = cloud_pool_->acquire();
+  points_ = &buffer_pc_->points;
+}
+
+PacketDecoder::PacketDecoder(const PacketDecoder& other)
+  : cloud_pool_(other.cloud_pool_), channels_(other.channels_), scan_phase_(other.scan_phase_), last_phase_(0),
+    has_scanned_(false), scan_split_(0), points_(nullptr), slice_(nullptr), grid_columns_(0), grid_returns_(1),
+    grid_column_(0), range_image_pool_(other.range_image_pool_), intensity_image_pool_(other.intensity_image_pool_),
+    image_columns_(0), image_column_(0), range_encoding_(other.range_encoding_),
+    range_ticks_per_meter_(other.range_ticks_per_meter_), compute_xyz_(other.compute_xyz_)
+{
+}
+
+void PacketDecoder::setOrganized(double azimuth_resolution, size_t returns)
+{
+  grid_columns_ = azimuth_resolution > 0.0 ? static_cast<size_t>(std::round(360.0 / azimuth_resolution)) : 0;
+  grid_returns_ = std::max<size_t>(returns, 1);
+  grid_column_ = 0;
+  grid_filled_.assign(channels_, 0);
+  buffer_pc_.reset();
+  buffer_pc_ = grid_columns_ > 0 ? acquireGrid() : cloud_pool_->acquire();
+  points_ = &buffer_pc_->points;
+}
+
+void PacketDecoder::setImages(double azimuth_resolution, RangeImageEncoding encoding, double tick)
+{
+  image_columns_ = azimuth_resolution > 0.0 ? static_cast<size_t>(std::round(360.0 / azimuth_resolution)) : 0;
+  image_column_ = 0;
+  range_encoding_ = encoding;
+  range_ticks_per_meter_ = tick > 0.0 ? static_cast<float>(1.0 / tick) : 0.0f;
+  range_scan_image_.reset();
+  intensity_scan_image_.reset();
+  if (image_columns_ == 0) {
+    range_image_.reset();
+    intensity_image_.reset();
+    return;
+  }
+  splitImages();
+}
+
+void PacketDecoder::splitImages()
+{
+  // dropping the previous scan's images first lets the pools hand them out again
+  range_scan_image_ = range_image_;
+  intensity_scan_image_ = intensity_image_;
+  if (range_encoding_ == RangeImageEncoding::FLOAT_METERS) {
+    range_image_ = range_image_pool_->acquire(channels_, image_columns_, "32FC1", sizeof(float));
+    float* pixels = reinterpret_cast<float*>(range_image_->data.data());
+    std::fill(pixels, pixels + channels_ * image_columns_, std::numeric_limits<float>::quiet_NaN());
+  }
+  else {
+    range_image_ = range_image_pool_->acquire(channels_, image_columns_, "16UC1", sizeof(uint16_t));
+    std::fill(range_image_->data.begin(), range_image_->data.end(), 0);
+  }
+  intensity_image_ = intensity_image_pool_->acquire(channels_, image_columns_, "mono8", 1);
+  std::fill(intensity_image_->data.begin(), intensity_image_->data.end(), 0);
+}
+
+PointcloudXYZIRADT PacketDecoder::acquireGrid()
+{
+  PointcloudXYZIRADT grid = cloud_pool_->acquire();
+  const size_t width = grid_columns_ * grid_returns_;
+  PointXYZIRADT missing;
+  missing.x = missing.y = missing.z = std::numeric_limits<float>::quiet_NaN();
+  missing.intensity = 0.0f;
+  missing.azimuth = 0.0f;
+  missing.distance = std::numeric_limits<float>::quiet_NaN();
+  missing.return_type = 0;
+  missing.time_stamp = 0.0;
+  grid->points.resize(channels_ * width);
+  for (size_t ring = 0; ring < channels_; ++ring) {
+    missing.ring = ring;
+    std::fill(grid->points.begin() + ring * width, grid->points.begin() + (ring + 1) * width, missing);
+  }
+  grid->width = width;
+  grid->height = channels_;
+  grid->is_dense = false;
+  return grid;
+}
+
+void PacketDecoder::splitGrid()
+{
+  scan_pc_.reset();
+  PointcloudXYZIRADT next_pc = acquireGrid();
+  scan_pc_ = buffer_pc_;
+  buffer_pc_ = next_pc;
+  points_ = &buffer_pc_->points;
+  std::fill(grid_filled_.begin(), grid_filled_.end(), 0);
+}
+
+void PacketDecoder::widenGrid(size_t returns)
+{
+  // move the cells of the scan in progress to a grid with room for returns points each
+  const size_t old_returns = grid_returns_;
+  PointcloudXYZIRADT old_pc = buffer_pc_;
+  grid_returns_ = returns;
+  buffer_pc_ = acquireGrid();
+  for (size_t cell = 0; cell < channels_ * grid_columns_; ++cell) {
+    std::copy_n(old_pc->points.begin() + cell * old_returns, old_returns,
+                buffer_pc_->points.begin() + cell * returns);
+  }
+  points_ = &buffer_pc_->points;
+}
+
+void PacketDecoder::unpackSlice(const uint8_t* data, size_t size, Slice& slice)
+{
+  slice_ = &slice;
+  points_ = &slice.points;
+  const size_t packet_count = slice.packets.size();
+  unpack(data, size);
+  // beginPacket() added the entry unless the decoder rejected the datagram
+  if (slice.packets.size() == packet_count) {
+    slice.packets.push_back({ false, 0, 0 });
+  }
+  slice.packets.back().block_end = slice.blocks.size();
+  slice_ = nullptr;
+  points_ = buffer_pc_ ? &buffer_pc_->points : nullptr;
+}
+
+void PacketDecoder::replay(const Slice& slice, size_t index)
+{
+  const Slice::Packet& packet = slice.packets[index];
+  if (!packet.valid) {
+    return;
+  }
+  beginPacket();
+  if (packet.returns > 0) {
+    setPacketReturns(packet.returns);
+  }
+  size_t block = index > 0 ? slice.packets[index - 1].block_end : 0;
+  for (; block < packet.block_end; ++block) {
+    checkPhase(slice.blocks[block].azimuth);
+    const size_t last_point =
+        block + 1 < slice.blocks.size() ? slice.blocks[block + 1].first_point : slice.points.size();
+    if (grid_columns_ > 0 || image_columns_ > 0) {
+      for (size_t point = slice.blocks[block].first_point; point < last_point; ++point) {
+        storePoint(slice.points[point], slice.ranges.empty() ? slice.points[point].distance : slice.ranges[point]);
+      }
+    }
+    else {
+      points_->insert(points_->end(), slice.points.begin() + slice.blocks[block].first_point,
+                      slice.points.begin() + last_point);
+    }
+  }
+  endPacket();
+}
+
+void PacketDecoder::endPacket()
+{
+  // an organized scan was already handed over by splitGrid()
+  if (!has_scanned_ || grid_columns_ > 0) {
+    return;
+  }
+  // drop the previous scan first, it is the next buffer unless a subscriber still holds it
+  scan_pc_.reset();
+  PointcloudXYZIRADT next_pc = cloud_pool_->acquire();
+
+  // the blocks after the split start the next scan
+  auto& points = buffer_pc_->points;
+  next_pc->points.insert(next_pc->points.end(), points.begin() + scan_split_, points.end());
+  points.erase(points.begin() + scan_split_, points.end());
+  buffer_pc_->width = points.size();
+  buffer_pc_->height = 1;
+
+  scan_pc_ = buffer_pc_;
+  buffer_pc_ = next_pc;
+  points_ = &buffer_pc_->points;
+}
+}  // namespace pandar_pointcloud
@@ -3,10 +3,37 @@
 
 namespace
 {
-static inline double deg2rad(double degrees)
-{
-  return degrees * M_PI / 180.0;
-}
+// nominal channel angles, used instead of the calibration
+const float ELEV_ANGLE[] = {
+  -52.6267f, -51.0280f, -49.5149f, -48.0739f, -46.6946f, -45.3688f, -44.0897f, -42.8519f, -41.6506f, -40.4822f,
+  -39.3432f, -38.2308f, -37.1426f, -36.0763f, -35.0301f, -34.0024f, -32.9915f, -31.9963f, -31.0154f, -30.0478f,
+  -29.0926f, -28.1488f, -27.2156f, -26.2924f, -25.3783f, -24.4728f, -23.5754f, -22.6854f, -21.8024f, -20.9259f,
+  -20.0555f, -19.1908f, -18.3313f, -17.4769f, -16.6270f, -15.7814f, -14.9399f, -14.1020f, -13.2676f, -12.4364f,
+  -11.6081f, -10.7826f, -9.9595f,  -9.1386f,  -8.3199f,  -7.5030f,  -6.6878f,  -5.8739f,  -5.0613f,  -4.2499f,
+  -3.4394f,  -2.6296f,  -1.8203f,  -1.0115f,  -0.2028f,  0.6057f,   1.4144f,   2.2234f,   3.0329f,   3.8431f,
+  4.6540f,   5.4660f,   6.2791f,   7.0936f,   7.9097f,   8.7275f,   9.5473f,   10.3692f,  11.1935f,  12.0204f,
+  12.8501f,  13.6829f,  14.5190f,  15.3586f,  16.2022f,  17.0498f,  17.9020f,  18.7589f,  19.6209f,  20.4884f,
+  21.3618f,  22.2414f,  23.1279f,  24.0215f,  24.9229f,  25.8326f,  26.7511f,  27.6792f,  28.6176f,  29.5670f,
+  30.5282f,  31.5023f,  32.4902f,  33.4931f,  34.5122f,  35.5489f,  19.1908f,  20.0555f,  20.9259f,  21.8024f,
+  22.6854f,  23.5754f,  24.4728f,  25.3783f,  26.2924f,  27.2156f,  28.1488f,  29.0926f,  30.0478f,  31.0154f,
+  31.9963f,  32.9915f,  34.0024f,  35.0301f,  36.0763f,  37.1426f,  38.2308f,  39.3432f,  40.4822f,  41.6506f,
+  42.8519f,  44.0897f,  45.3688f,  46.6946f,  48.0739f,  49.5149f,  51.0280f,  52.6267f
+};
+
+const float AZIMUTH_OFFSET[] = {
+  10.6267f, 9.0280f,  9.5149f,  9.0739f,  8.6946f,  8.3688f,  8.0897f,  8.8519f,  8.6506f,  7.4822f,  7.3432f,
+  7.2308f,  7.1426f,  7.0763f,  7.0301f,  7.0024f,  7.9915f,  7.9963f,  6.0154f,  6.0478f,  6.0926f,  6.1488f,
+  6.2156f,  6.2924f,  6.3783f,  6.4728f,  6.5754f,  6.6854f,  6.8024f,  6.9259f,  6.0555f,  6.1908f,  -6.3313f,
+  -6.4769f, -6.6270f, -6.7814f, -6.9399f, -6.1020f, -6.2676f, -6.4364f, -6.6081f, -5.7826f, -5.9595f, -5.1386f,
+  -5.3199f, -5.5030f, -5.6878f, -5.8739f, -5.0613f, -5.2499f, -5.4394f, -5.6296f, -5.8203f, -5.0115f, -5.2028f,
+  -5.6057f, -5.4144f, -5.2234f, -5.0329f, -5.8431f, -5.6540f, -5.4660f, -5.2791f, -5.0936f, 5.9097f,  5.7275f,
+  5.5473f,  5.3692f,  6.1935f,  6.0204f,  6.8501f,  6.6829f,  6.5190f,  6.3586f,  6.2022f,  6.0498f,  6.9020f,
+  6.7589f,  6.6209f,  6.4884f,  6.3618f,  6.2414f,  6.1279f,  6.0215f,  6.9229f,  6.8326f,  6.7511f,  6.6792f,
+  6.6176f,  6.5670f,  6.5282f,  6.5023f,  7.4902f,  7.4931f,  7.5122f,  7.5489f,  -6.1908f, -6.0555f, -6.9259f,
+  -6.8024f, -6.6854f, -6.5754f, -6.4728f, -6.3783f, -6.2924f, -6.2156f, -6.1488f, -6.0926f, -6.0478f, -6.0154f,
+  -7.9963f, -7.9915f, -7.0024f, -7.0301f, -7.0763f, -7.1426f, -7.2308f, -7.3432f, -7.4822f, -8.6506f, -8.8519f,
+  -8.0897f, -8.3688f, -8.6946f, -9.0739f, -9.5149f, -9.0280f, -10.6267f
+};
 }  // namespace
 
 namespace pandar_pointcloud
@@ -15,6 +42,7 @@ namespace pandar_qt128
 {
 PandarQT128Decoder::PandarQT128Decoder(Calibration& calibration, float scan_phase,
                                        double dual_return_distance_threshold, ReturnMode return_mode)
+  : Engine(MAX_POINTS_PER_SCAN, scan_phase)
 {
   initFiringOffset();
 
@@ -24,155 +52,125 @@ PandarQT128Decoder::PandarQT128Decoder(Calibration& calibration, float scan_phas
   block_offset_dual_[1] = 7.0f * 0.0f + 111.11f;
   block_offset_dual_[0] = 7.0f * 0.0f + 111.11f;
 
-  // TODO: add calibration data validation
-  // if(calibration.elev_angle_map.size() != num_lasers_){
-  //   // calibration data is not valid!
-  // }
+  setChannelAngles(ELEV_ANGLE, AZIMUTH_OFFSET);
 
-  scan_phase_ = static_cast<uint16_t>(scan_phase * 100.0f);
   return_mode_ = return_mode;
   dual_return_distance_threshold_ = dual_return_distance_threshold;
-
-  last_phase_ = 0;
-  has_scanned_ = false;
-
-  scan_pc_.reset(new pcl::PointCloud<PointXYZIRADT>);
-  overflow_pc_.reset(new pcl::PointCloud<PointXYZIRADT>);
 }
 
-bool PandarQT128Decoder::hasScanned()
+double PandarQT128Decoder::packetTime()
 {
-  return has_scanned_;
+  return utc_cache_.epoch(packet_->tail.date_time) + (packet_->tail.timestamp % 1000000) / 1000000.0;
 }
 
-PointcloudXYZIRADT PandarQT128Decoder::getPointcloud()
+void PandarQT128Decoder::convertPacket()
 {
-  return scan_pc_;
-}
-
-void PandarQT128Decoder::unpack(const pandar_msgs::PandarPacket& raw_packet)
-{
-  if (!parsePacket(raw_packet))
-  {
-    return;
-  }
-
-  if (has_scanned_)
-  {
-    scan_pc_ = overflow_pc_;
-    overflow_pc_.reset(new pcl::PointCloud<PointXYZIRADT>);
-    has_scanned_ = false;
-  }
-
-  bool dual_return = (packet_.return_mode == DUAL_RETURN);
+  bool dual_return = (packet_->tail.return_mode == DUAL_RETURN);
   auto step = dual_return ? 2 : 1;
 
   if (!dual_return)
   {
-    if ((packet_.return_mode == FIRST_RETURN && return_mode_ != ReturnMode::FIRST) ||
-        (packet_.return_mode == LAST_RETURN && return_mode_ != ReturnMode::LAST))
+    if ((packet_->tail.return_mode == FIRST_RETURN && return_mode_ != ReturnMode::FIRST) ||
+        (packet_->tail.return_mode == LAST_RETURN && return_mode_ != ReturnMode::LAST))
     {
       ROS_WARN("Sensor return mode configuration does not match requested return mode");
     }
   }
 
-  for (int block_id = 0; block_id < BLOCK_NUM; block_id += step)
+  convertBlocks(BLOCK_NUM, step, selectConvert(dual_return));
+}
+
+PandarQT128Decoder::ConvertBlock PandarQT128Decoder::selectConvert(bool dual_return) const
+{
+  if (!dual_return)
   {
-    auto block_pc = dual_return ? convert_dual(block_id) : convert(block_id);
-    int current_phase = (static_cast<int>(packet_.blocks[block_id].azimuth) - scan_phase_ + 36000) % 36000;
-    if (current_phase > last_phase_ && !has_scanned_)
-    {
-      *scan_pc_ += *block_pc;
-    }
-    else
-    {
-      *overflow_pc_ += *block_pc;
-      has_scanned_ = true;
-    }
-    last_phase_ = current_phase;
+    return &PandarQT128Decoder::convert;
   }
-  return;
+  switch (return_mode_)
+  {
+    case ReturnMode::FIRST:
+      return &PandarQT128Decoder::convert_dual<ReturnMode::FIRST>;
+    case ReturnMode::LAST:
+      return &PandarQT128Decoder::convert_dual<ReturnMode::LAST>;
+    default:
+      return &PandarQT128Decoder::convert_dual<ReturnMode::DUAL>;
+  }
+}
+
+double PandarQT128Decoder::distance(const Unit& unit) const
+{
+  return static_cast<double>(unit.distance * packet_->header.u8DistUnit) / (double)1000;
+}
+
+template <bool Dual>
+double PandarQT128Decoder::pointTime(int block_id, int unit_id, int seq_id) const
+{
+  const auto& block_offset = Dual ? block_offset_dual_ : block_offset_single_;
+  return packet_time_ + static_cast<double>(block_offset[block_id] + firing_offset_[seq_id][unit_id]) * 1e-06f;
 }
 
+template <bool Dual>
 PointXYZIRADT PandarQT128Decoder::build_point(int block_id, int unit_id, int seq_id, uint8_t return_type)
 {
-  const auto& block = packet_.blocks[block_id];
+  const auto& block = packet_->blocks[block_id];
   const auto& unit = block.units[unit_id];
-  double unix_second = static_cast<double>(timegm(&packet_.t));
-  bool dual_return = (packet_.return_mode == DUAL_RETURN);
-  PointXYZIRADT point;
-
-  double xyDistance = unit.distance * cosf(deg2rad(elev_angle_[unit_id]));
-
-  point.x = static_cast<float>(xyDistance *
-                               sinf(deg2rad(azimuth_offset_[unit_id] + (static_cast<double>(block.azimuth)) * 1e-02)));
-  point.y = static_cast<float>(xyDistance *
-                               cosf(deg2rad(azimuth_offset_[unit_id] + (static_cast<double>(block.azimuth)) * 1e-02)));
-  point.z = static_cast<float>(unit.distance * sinf(deg2rad(elev_angle_[unit_id])));
-
-  point.intensity = unit.intensity;
-  point.distance = unit.distance;
-  point.ring = unit_id;
-  point.azimuth = block.azimuth + round(azimuth_offset_[unit_id] * 100.0f);
-  point.return_type = return_type;
-  point.time_stamp = unix_second + (static_cast<double>(packet_.usec)) * 1e-06f;
-  point.time_stamp +=
-      dual_return ? (static_cast<double>(block_offset_dual_[block_id] + firing_offset_[seq_id][unit_id]) * 1e-06f) :
-                    (static_cast<double>(block_offset_single_[block_id] + firing_offset_[seq_id][unit_id]) * 1e-06f);
-
+  PointXYZIRADT point = makePoint(unit_id, block.azimuth, distance(unit), unit.intensity, return_type);
+  point.time_stamp = pointTime<Dual>(block_id, unit_id, seq_id);
   return point;
 }
 
-PointcloudXYZIRADT PandarQT128Decoder::convert(const int block_id)
+void PandarQT128Decoder::convert(const int block_id)
 {
-  PointcloudXYZIRADT block_pc(new pcl::PointCloud<PointXYZIRADT>);
-
   int seq_id = block_id;
+  const uint8_t return_type =
+      (packet_->tail.return_mode == FIRST_RETURN) ? ReturnType::SINGLE_FIRST : ReturnType::SINGLE_LAST;
+
+  const auto& block = packet_->blocks[block_id];
+  if (useBlockKernel())
+  {
+    convertKernelBlock(block, packet_->header.u8DistUnit * 0.001f, return_type,
+                       [this, block_id, seq_id](int unit_id) { return pointTime<false>(block_id, unit_id, seq_id); });
+    return;
+  }
 
-  const auto& block = packet_.blocks[block_id];
   for (size_t unit_id = 0; unit_id < UNIT_NUM; ++unit_id)
   {
-    PointXYZIRADT point;
-    const auto& unit = block.units[unit_id];
     // skip invalid points
-    if (unit.distance <= 0.1 || unit.distance > 200.0)
+    if (!inRange(distance(block.units[unit_id])))
     {
       continue;
     }
-    block_pc->push_back(
-        build_point(block_id, unit_id, seq_id,
-                    (packet_.return_mode == FIRST_RETURN) ? ReturnType::SINGLE_FIRST : ReturnType::SINGLE_LAST));
+    addPoint(build_point<false>(block_id, unit_id, seq_id, return_type));
   }
-  return block_pc;
 }
 
-PointcloudXYZIRADT PandarQT128Decoder::convert_dual(const int block_id)
+template <PandarQT128Decoder::ReturnMode Mode>
+void PandarQT128Decoder::convert_dual(const int block_id)
 {
   //   Under the Dual Return mode, the ranging data from each firing is stored in two adjacent blocks:
   // · The even number block is the first return
   // · The odd number block is the last return
   // · The Azimuth changes every two blocks
   // · Important note: Hesai datasheet block numbering starts from 0, not 1, so odd/even are reversed here
-  PointcloudXYZIRADT block_pc(new pcl::PointCloud<PointXYZIRADT>);
 
   int even_block_id = block_id;
   int odd_block_id = block_id + 1;
-  const auto& even_block = packet_.blocks[even_block_id];
-  const auto& odd_block = packet_.blocks[odd_block_id];
+  const auto& even_block = packet_->blocks[even_block_id];
+  const auto& odd_block = packet_->blocks[odd_block_id];
 
   int seq_id;
-  if (return_mode_ == ReturnMode::DUAL)
+  if (Mode == ReturnMode::DUAL)
   {
-    if ((packet_.mode_flag >> 0) & 0x01)
+    if ((packet_->tail.mode_flag >> 0) & 0x01)
     {
-      if ((packet_.mode_flag >> 1) & 0x01)
+      if ((packet_->tail.mode_flag >> 1) & 0x01)
         seq_id = 0;
       else
         seq_id = block_id;
     }
     else
     {
-      if ((packet_.mode_flag >> 1) & 0x01)
+      if ((packet_->tail.mode_flag >> 1) & 0x01)
         seq_id = 1 - block_id;
       else
         seq_id = 1;
@@ -188,126 +186,67 @@ PointcloudXYZIRADT PandarQT128Decoder::convert_dual(const int block_id)
     const auto& even_unit = even_block.units[unit_id];
     const auto& odd_unit = odd_block.units[unit_id];
 
-    bool even_usable = (even_unit.distance <= 0.1 || even_unit.distance > 200.0) ? 0 : 1;
-    bool odd_usable = (odd_unit.distance <= 0.1 || odd_unit.distance > 200.0) ? 0 : 1;
+    const double even_distance = distance(even_unit);
+    const double odd_distance = distance(odd_unit);
+    bool even_usable = inRange(even_distance);
+    bool odd_usable = inRange(odd_distance);
 
-    if (return_mode_ == ReturnMode::FIRST && even_usable)
+    if (Mode == ReturnMode::FIRST && even_usable)
     {
       // First return is in even block
-      block_pc->push_back(build_point(even_block_id, unit_id, seq_id, ReturnType::SINGLE_FIRST));
+      addPoint(build_point<true>(even_block_id, unit_id, seq_id, ReturnType::SINGLE_FIRST));
     }
-    else if (return_mode_ == ReturnMode::LAST && even_usable)
+    else if (Mode == ReturnMode::LAST && even_usable)
     {
       // Last return is in odd block
-      block_pc->push_back(build_point(odd_block_id, unit_id, seq_id, ReturnType::SINGLE_LAST));
+      addPoint(build_point<true>(odd_block_id, unit_id, seq_id, ReturnType::SINGLE_LAST));
     }
-    else if (return_mode_ == ReturnMode::DUAL)
+    else if (Mode == ReturnMode::DUAL)
     {
       // If the two returns are too close, only return the last one
-      if ((abs(even_unit.distance - odd_unit.distance) < dual_return_distance_threshold_) && odd_usable)
+      if ((abs(even_distance - odd_distance) < dual_return_distance_threshold_) && odd_usable)
       {
-        block_pc->push_back(build_point(odd_block_id, unit_id, seq_id, ReturnType::DUAL_ONLY));
+        addPoint(build_point<true>(odd_block_id, unit_id, seq_id, ReturnType::DUAL_ONLY));
       }
       else
       {
         if (even_usable)
         {
-          block_pc->push_back(build_point(even_block_id, unit_id, seq_id, ReturnType::DUAL_FIRST));
+          addPoint(build_point<true>(even_block_id, unit_id, seq_id, ReturnType::DUAL_FIRST));
         }
         if (odd_usable)
         {
-          block_pc->push_back(build_point(odd_block_id, unit_id, seq_id, ReturnType::DUAL_LAST));
+          addPoint(build_point<true>(odd_block_id, unit_id, seq_id, ReturnType::DUAL_LAST));
         }
       }
     }
   }
-  return block_pc;
 }
 
-bool PandarQT128Decoder::parsePacket(const pandar_msgs::PandarPacket& raw_packet)
+bool PandarQT128Decoder::parsePacket(const uint8_t* data, size_t size)
 {
-  if (raw_packet.size != PACKET_SIZE)
+  if (size != PACKET_SIZE)
   {
     return false;
   }
-  const uint8_t* buf = &raw_packet.data[0];
-
-  size_t index = 0;
-  // Parse 12 Bytes Header
-  packet_.header.u16Sob = ((buf[index] & 0xff) << 8) | ((buf[index + 1] & 0xff));
-  packet_.header.u8ProtocolMajor = buf[index + 2] & 0xff;
-  packet_.header.u8ProtocolMinor = buf[index + 3] & 0xff;
-  /* <--- Reserved 2 bytes [index + 4], [index + 5] ---> */
-  packet_.header.u8LaserNum = buf[index + 6] & 0xff;
-  packet_.header.u8BlockNum = buf[index + 7] & 0xff;
-  /* <--- Reserved 1 byte [index + 8] ---> */
-  packet_.header.u8DistUnit = buf[index + 9] & 0xff;
-  packet_.header.u8EchoNum = buf[index + 10] & 0xff;
-  packet_.header.u8Flags = buf[index + 11] & 0xff;
-  index += HEAD_SIZE;
-
-  if (packet_.header.u16Sob != 0xEEFF)
+  packet_ = reinterpret_cast<const Packet*>(data);
+
+  if (packet_->header.u16Sob != 0xFFEE)
   {
     // Error Start of Packet!
     return false;
   }
-
-  // Parse 1032 Bytes Body
-  for (size_t block = 0; block < packet_.header.u8BlockNum; block++)
-  {
-    packet_.blocks[block].azimuth = (buf[index] & 0xff) | ((buf[index + 1] & 0xff) << 8);
-    index += BLOCK_HEADER_AZIMUTH;
-
-    for (int unit = 0; unit < packet_.header.u8LaserNum; unit++)
-    {
-      unsigned int unRange = (buf[index] & 0xff) | ((buf[index + 1] & 0xff) << 8);
-
-      packet_.blocks[block].units[unit].distance =
-          (static_cast<double>(unRange * packet_.header.u8DistUnit)) / (double)1000;
-      packet_.blocks[block].units[unit].intensity = (buf[index + 2] & 0xff);
-      index += UNIT_SIZE;
-    }
-  }
-
-  index += CRC_1_SIZE;
-
-  // Parse 17 Bytes Functional Safety
-  index += FUNCTIONAL_SAFETY_SIZE;
-
-  // Parse 34 Bytes Tail
-  index += RESERVED_1_SIZE;
-
-  packet_.mode_flag = buf[index] & 0xff;
-  index += MODE_FLAG_SIZE;
-
-  index += RESERVED_2_SIZE;
-
-  packet_.return_mode = buf[index] & 0xff;
-  index += RETURN_MODE_SIZE;
-
-  index += MOTOR_SPEED_SIZE;
-
-  packet_.t.tm_year = (buf[index + 0] & 0xff) + 100;  // Year (Current year minus 1900)
-  packet_.t.tm_mon = (buf[index + 1] & 0xff) - 1;     // Month
-  packet_.t.tm_mday = buf[index + 2] & 0xff;          // Day
-  packet_.t.tm_hour = buf[index + 3] & 0xff;          // Hour
-  packet_.t.tm_min = buf[index + 4] & 0xff;           // Minute
-  packet_.t.tm_sec = buf[index + 5] & 0xff;           // Second
-  packet_.t.tm_isdst = 0;
-
-  // in case of time error
-  if (packet_.t.tm_year >= 200)
-  {
-    packet_.t.tm_year -= 100;
-  }
-
-  index += DATE_TIME_SIZE;
-
   return true;
 }
 
 void PandarQT128Decoder::initFiringOffset()
 {
+  // each sequence fires 96 of the channels, the others keep no offset
+  for (auto& offsets : firing_offset_)
+  {
+    offsets.fill(0.0f);
+  }
+
   /* Firing Order 1-10 @ p. 62 User Manual */
   /* Firing Order 1 */
   firing_offset_[0][99 - 1] = 0.6f;
@@ -0,0 +1,21 @@
+#include "pandar_pointcloud/decoder/trig_table.hpp"
+
+namespace pandar_pointcloud
+{
+constexpr int TrigTable::STEPS;
+
+const TrigTable& TrigTable::instance()
+{
+  static const TrigTable table;
+  return table;
+}
+
+TrigTable::TrigTable() : sin_(STEPS), cos_(STEPS)
+{
+  for (int i = 0; i < STEPS; ++i) {
+    const double rad = i * M_PI / 18000.0;
+    sin_[i] = static_cast<float>(std::sin(rad));
+    cos_[i] = static_cast<float>(std::cos(rad));
+  }
+}
+}  // namespace pandar_pointcloud
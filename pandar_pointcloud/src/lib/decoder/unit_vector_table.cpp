@@ -0,0 +1,27 @@
+#include "pandar_pointcloud/decoder/unit_vector_table.hpp"
+#include <algorithm>
+
+namespace pandar_pointcloud
+{
+UnitVectorTable::UnitVectorTable(const float* elev_angle, const float* azimuth_offset, size_t channels,
+                                 double resolution)
+{
+  step_size_ = std::min(std::max(static_cast<int>(std::lround(resolution * 100.0)), 1), TrigTable::STEPS);
+  half_step_ = step_size_ / 2;
+  steps_ = (TrigTable::STEPS + step_size_ - 1) / step_size_;
+  vectors_.resize(channels * steps_);
+
+  for (size_t channel = 0; channel < channels; ++channel) {
+    const double elev = elev_angle[channel] * M_PI / 180.0;
+    const double cos_elev = std::cos(elev);
+    const double sin_elev = std::sin(elev);
+    for (int step = 0; step < steps_; ++step) {
+      const double azimuth = (step * step_size_ / 100.0 + azimuth_offset[channel]) * M_PI / 180.0;
+      Vector& v = vectors_[channel * steps_ + step];
+      v.x = static_cast<float>(cos_elev * std::sin(azimuth));
+      v.y = static_cast<float>(cos_elev * std::cos(azimuth));
+      v.z = static_cast<float>(sin_elev);
+    }
+  }
+}
+}  // namespace pandar_pointcloud
@@ -0,0 +1,68 @@
+#include "pandar_pointcloud/image_pool.hpp"
+
+namespace pandar_pointcloud
+{
+std::shared_ptr<ImagePool> ImagePool::create(size_t max_idle)
+{
+  return std::shared_ptr<ImagePool>(new ImagePool(max_idle));
+}
+
+ImagePool::ImagePool(size_t max_idle) : max_idle_(max_idle)
+{
+  idle_.reserve(max_idle_);
+}
+
+ImagePool::~ImagePool()
+{
+  for (auto image : idle_) {
+    delete image;
+  }
+}
+
+sensor_msgs::ImagePtr ImagePool::acquire(uint32_t height, uint32_t width, const std::string& encoding,
+                                         size_t pixel_size)
+{
+  sensor_msgs::Image* image = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!idle_.empty()) {
+      image = idle_.back();
+      idle_.pop_back();
+    }
+  }
+  if (image == nullptr) {
+    image = new sensor_msgs::Image;
+  }
+
+  image->height = height;
+  image->width = width;
+  image->encoding = encoding;
+  image->is_bigendian = false;
+  image->step = width * pixel_size;
+  // a recycled buffer of the same size is not reallocated
+  image->data.resize(image->step * height);
+
+  // the pool may be gone by the time a subscriber drops the last reference
+  std::weak_ptr<ImagePool> pool = shared_from_this();
+  return sensor_msgs::ImagePtr(image, [pool](sensor_msgs::Image* image) {
+    if (auto owner = pool.lock()) {
+      owner->release(image);
+    }
+    else {
+      delete image;
+    }
+  });
+}
+
+void ImagePool::release(sensor_msgs::Image* image)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_.size() < max_idle_) {
+      idle_.push_back(image);
+      return;
+    }
+  }
+  delete image;
+}
+}  // namespace pandar_pointcloud
@@ -1,5 +1,6 @@
 #include "pandar_pointcloud/pandar_cloud.hpp"
 #include <pandar_msgs/PandarScan.h>
+#include <pcl_conversions/pcl_conversions.h>
 #include "pandar_pointcloud/calibration.hpp"
 #include "pandar_pointcloud/decoder/pandar40_decoder.hpp"
 #include "pandar_pointcloud/decoder/pandar_qt_decoder.hpp"
@@ -20,14 +21,49 @@ const double TCP_RETRY_WAIT_SEC = 0.1;
 
 namespace pandar_pointcloud
 {
+namespace
+{
+// time of the first return, the leading cells of an organized scan may be empty
+double scanStartTime(const pcl::PointCloud<PointXYZIRADT>& cloud)
+{
+  if (cloud.height <= 1) {
+    return cloud.points[0].time_stamp;
+  }
+  for (size_t column = 0; column < cloud.width; ++column) {
+    for (size_t row = 0; row < cloud.height; ++row) {
+      const PointXYZIRADT& point = cloud.points[row * cloud.width + column];
+      if (std::isfinite(point.distance)) {
+        return point.time_stamp;
+      }
+    }
+  }
+  return 0.0;
+}
+}  // namespace
+
 PandarCloud::PandarCloud(ros::NodeHandle node, ros::NodeHandle private_nh)
+  : sector_published_(0), reported_pipeline_drops_(0)
 {
+  int pipeline_queue;
+  std::string pipeline_overflow;
+  std::string range_image_encoding;
+  double range_image_unit;
   private_nh.getParam("scan_phase", scan_phase_);
   private_nh.getParam("return_mode", return_mode_);
   private_nh.getParam("dual_return_distance_threshold", dual_return_distance_threshold_);
   private_nh.getParam("calibration", calibration_path_);
   private_nh.getParam("model", model_);
   private_nh.getParam("device_ip", device_ip_);
+  private_nh.param("compact_scan", compact_scan_, false);
+  private_nh.param("unit_vector_resolution", unit_vector_resolution_, 0.0);
+  private_nh.param("decode_threads", decode_threads_, 1);
+  private_nh.param("organized_resolution", organized_resolution_, 0.0);
+  private_nh.param("image_resolution", image_resolution_, 0.0);
+  private_nh.param("range_image_encoding", range_image_encoding, std::string("32FC1"));
+  private_nh.param("range_image_unit", range_image_unit, 0.004);
+  private_nh.param("pipeline", pipeline_, false);
+  private_nh.param("pipeline_queue", pipeline_queue, 2);
+  private_nh.param("pipeline_overflow", pipeline_overflow, std::string("drop_oldest"));
 
   tcp_client_ = std::make_shared<pandar_api::TCPClient>(device_ip_);
   if (!setupCalibration()) {
@@ -166,15 +202,162 @@ PandarCloud::PandarCloud(ros::NodeHandle node, ros::NodeHandle private_nh)
     return;
   }
 
-  pandar_packet_sub_ =
-      node.subscribe("pandar_packets", 10, &PandarCloud::onProcessScan, this, ros::TransportHints().tcpNoDelay(true));
+  if (unit_vector_resolution_ > 0.0) {
+    size_t bytes = decoder_->setUnitVectorResolution(unit_vector_resolution_);
+    ROS_INFO("unit vector table at %.2f deg: %.1f MB", unit_vector_resolution_, bytes / (1024.0 * 1024.0));
+  }
+  if (organized_resolution_ > 0.0) {
+    // decoders that emit every return of the packet widen the columns to the packet's return mode
+    decoder_->setOrganized(organized_resolution_, return_mode_ == "Triple" ? 3 : (return_mode_ == "Dual" ? 2 : 1));
+    ROS_INFO("organized scans with a column every %.2f deg", organized_resolution_);
+  }
+  if (image_resolution_ > 0.0) {
+    RangeImageEncoding encoding = RangeImageEncoding::FLOAT_METERS;
+    if (range_image_encoding == "16UC1") {
+      encoding = RangeImageEncoding::UINT16_TICKS;
+    }
+    else if (range_image_encoding != "32FC1") {
+      ROS_ERROR("Invalid range image encoding, defaulting to 32FC1");
+    }
+    decoder_->setImages(image_resolution_, encoding, range_image_unit);
+  }
+  cloud_writer_ = CloudWriter::create();
+  if (decode_threads_ > 1) {
+    decode_pool_.reset(new DecodePool(*decoder_, decode_threads_));
+    ROS_INFO("decoding scans on %d threads", decode_threads_);
+  }
+
+  updater_.setHardwareIDf("%s: %s", model_.c_str(), device_ip_.c_str());
+  updater_.add("pandar_cloud_pool", this, &PandarCloud::checkCloudPool);
+
+  if (pipeline_) {
+    OverflowPolicy policy = OverflowPolicy::DROP_OLDEST;
+    if (pipeline_overflow == "block") {
+      policy = OverflowPolicy::BLOCK;
+    }
+    else if (pipeline_overflow != "drop_oldest") {
+      ROS_ERROR("Invalid pipeline overflow policy, defaulting to drop_oldest");
+    }
+    startPipeline(std::max(pipeline_queue, 1), policy);
+    updater_.add("pandar_cloud_pipeline", this, &PandarCloud::checkPipeline);
+  }
+
+  if (compact_scan_) {
+    pandar_packet_sub_ = node.subscribe("pandar_compact_packets", 10, &PandarCloud::onProcessCompactScan, this,
+                                        ros::TransportHints().tcpNoDelay(true));
+  }
+  else {
+    pandar_packet_sub_ =
+        node.subscribe("pandar_packets", 10, &PandarCloud::onProcessScan, this, ros::TransportHints().tcpNoDelay(true));
+  }
   pandar_points_pub_ = node.advertise<sensor_msgs::PointCloud2>("pandar_points", 10);
   pandar_points_ex_pub_ = node.advertise<sensor_msgs::PointCloud2>("pandar_points_ex", 10);
+  pandar_sector_points_pub_ = node.advertise<pandar_msgs::PandarSectorCloud>("pandar_sector_points", 10);
+  if (decoder_->hasImages()) {
+    pandar_range_image_pub_ = node.advertise<sensor_msgs::Image>("pandar_range_image", 10);
+    pandar_intensity_image_pub_ = node.advertise<sensor_msgs::Image>("pandar_intensity_image", 10);
+  }
   ROS_INFO_STREAM("Ready");
 }
 
 PandarCloud::~PandarCloud()
 {
+  pandar_packet_sub_.shutdown();
+  if (pipeline_ && scan_queue_) {
+    scan_queue_->close();
+    convert_queue_->close();
+    publish_queue_->close();
+    decode_thread_.join();
+    convert_thread_.join();
+    publish_thread_.join();
+  }
+}
+
+void PandarCloud::startPipeline(size_t queue_size, OverflowPolicy policy)
+{
+  scan_queue_.reset(new BoundedQueue<ScanJob>(queue_size, policy));
+  convert_queue_.reset(new BoundedQueue<CloudJob>(queue_size, policy));
+  publish_queue_.reset(new BoundedQueue<CloudJob>(queue_size, policy));
+  decode_thread_ = std::thread(&PandarCloud::decodeLoop, this);
+  convert_thread_ = std::thread(&PandarCloud::convertLoop, this);
+  publish_thread_ = std::thread(&PandarCloud::publishLoop, this);
+}
+
+void PandarCloud::decodeLoop()
+{
+  ScanJob job;
+  while (scan_queue_->pop(job)) {
+    received_ = job.queued;
+    if (job.scan) {
+      processScan(job.scan);
+    }
+    else {
+      processCompactScan(job.compact_scan);
+    }
+    decode_latency_.add(job.queued);
+    job = ScanJob();
+  }
+}
+
+void PandarCloud::convertLoop()
+{
+  CloudJob job;
+  while (convert_queue_->pop(job)) {
+    serializeScan(job);
+    convert_latency_.add(job.queued);
+    job.queued = StageLatency::Clock::now();
+    publish_queue_->push(std::move(job));
+    // let go of the cloud so it can return to the pool while this stage waits
+    job = CloudJob();
+  }
+}
+
+void PandarCloud::publishLoop()
+{
+  CloudJob job;
+  while (publish_queue_->pop(job)) {
+    publishScan(job);
+    publish_latency_.add(job.queued);
+    total_latency_.add(job.received);
+    job = CloudJob();
+    updater_.update();
+  }
+}
+
+void PandarCloud::checkPipeline(diagnostic_updater::DiagnosticStatusWrapper& stat)
+{
+  // a stage whose latency keeps growing towards the scan period is the bottleneck
+  const std::pair<const char*, StageLatency*> stages[] = {
+    { "decode", &decode_latency_ },
+    { "convert", &convert_latency_ },
+    { "publish", &publish_latency_ },
+    { "total", &total_latency_ },
+  };
+  for (const auto& stage : stages) {
+    StageLatency::Summary summary = stage.second->take();
+    stat.addf(std::string(stage.first) + " count", "%lu", summary.count);
+    stat.addf(std::string(stage.first) + " mean ms", "%.2f", summary.mean_ms);
+    stat.addf(std::string(stage.first) + " max ms", "%.2f", summary.max_ms);
+  }
+
+  const auto scan_stats = scan_queue_->stats();
+  const auto convert_stats = convert_queue_->stats();
+  const auto publish_stats = publish_queue_->stats();
+  stat.add("scan queue high water", scan_stats.high_water);
+  stat.add("convert queue high water", convert_stats.high_water);
+  stat.add("publish queue high water", publish_stats.high_water);
+  stat.add("scan messages dropped", scan_stats.dropped);
+  stat.add("scans dropped", convert_stats.dropped + publish_stats.dropped);
+
+  const uint64_t drops = scan_stats.dropped + convert_stats.dropped + publish_stats.dropped;
+  if (drops > reported_pipeline_drops_) {
+    stat.summaryf(diagnostic_msgs::DiagnosticStatus::WARN, "%lu dropped by a full queue",
+                  drops - reported_pipeline_drops_);
+    reported_pipeline_drops_ = drops;
+  }
+  else {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "OK");
+  }
 }
 
 bool PandarCloud::setupCalibration()
@@ -209,45 +392,218 @@ bool PandarCloud::setupCalibration()
 
 void PandarCloud::onProcessScan(const pandar_msgs::PandarScan::ConstPtr& scan_msg)
 {
-  PointcloudXYZIRADT pointcloud;
-  pandar_msgs::PandarPacket pkt;
+  if (pipeline_) {
+    scan_queue_->push({ scan_msg, nullptr, StageLatency::Clock::now() });
+  }
+  else {
+    processScan(scan_msg);
+  }
+}
+
+void PandarCloud::onProcessCompactScan(const pandar_msgs::PandarCompactScan::ConstPtr& scan_msg)
+{
+  if (pipeline_) {
+    scan_queue_->push({ nullptr, scan_msg, StageLatency::Clock::now() });
+  }
+  else {
+    processCompactScan(scan_msg);
+  }
+}
 
+void PandarCloud::processScan(const pandar_msgs::PandarScan::ConstPtr& scan_msg)
+{
+  beginSector(scan_msg->sector_count);
+  packets_.clear();
   for (auto& packet : scan_msg->packets) {
-    decoder_->unpack(packet);
-    if (decoder_->hasScanned()) {
-      pointcloud = decoder_->getPointcloud();
-      if (pointcloud->points.size() > 0) {
-        pointcloud->header.stamp = pcl_conversions::toPCL(ros::Time(pointcloud->points[0].time_stamp));
-        pointcloud->header.frame_id = scan_msg->header.frame_id;
-        pointcloud->height = 1;
-
-        pandar_points_ex_pub_.publish(pointcloud);
-        if (pandar_points_pub_.getNumSubscribers() > 0) {
-          pandar_points_pub_.publish(convertPointcloud(pointcloud));
-        }
+    packets_.push_back({ packet.data.data(), packet.size });
+  }
+  decodePackets(scan_msg->header.frame_id, scan_msg->sector_count);
+  if (scan_msg->sector_count > 0) {
+    publishSector(scan_msg->header, scan_msg->sector_index, scan_msg->sector_count);
+  }
+}
+
+void PandarCloud::processCompactScan(const pandar_msgs::PandarCompactScan::ConstPtr& scan_msg)
+{
+  beginSector(scan_msg->sector_count);
+  packets_.clear();
+  bool malformed = false;
+  const size_t packet_count = scan_msg->offsets.size();
+  for (size_t i = 0; i < packet_count; ++i) {
+    size_t begin = scan_msg->offsets[i];
+    size_t end = (i + 1 < packet_count) ? scan_msg->offsets[i + 1] : scan_msg->data.size();
+    if (begin > end || end > scan_msg->data.size()) {
+      ROS_ERROR_THROTTLE(1.0, "Malformed compact scan: packet %zu spans [%zu, %zu)", i, begin, end);
+      malformed = true;
+      break;
+    }
+    packets_.push_back({ scan_msg->data.data() + begin, end - begin });
+  }
+  // the packets before a malformed one are still decoded, the sector is dropped
+  decodePackets(scan_msg->header.frame_id, scan_msg->sector_count);
+  if (malformed) {
+    return;
+  }
+  if (scan_msg->sector_count > 0) {
+    publishSector(scan_msg->header, scan_msg->sector_index, scan_msg->sector_count);
+  }
+}
+
+void PandarCloud::decodePackets(const std::string& frame_id, uint16_t sector_count)
+{
+  if (decoder_->hasImages()) {
+    // xyz only for point cloud subscribers
+    const bool compute_xyz = pandar_points_pub_.getNumSubscribers() > 0 ||
+                             pandar_points_ex_pub_.getNumSubscribers() > 0 ||
+                             pandar_sector_points_pub_.getNumSubscribers() > 0;
+    decoder_->setComputeXYZ(compute_xyz);
+    if (decode_pool_) {
+      decode_pool_->setComputeXYZ(compute_xyz);
+    }
+  }
+  if (!decode_pool_) {
+    for (const auto& packet : packets_) {
+      decoder_->unpack(packet.data, packet.size);
+      onPacketDecoded(frame_id, sector_count);
+    }
+    return;
+  }
+  const size_t slice_count = decode_pool_->decode(packets_);
+  for (size_t i = 0; i < slice_count; ++i) {
+    const PacketDecoder::Slice& slice = decode_pool_->slice(i);
+    for (size_t packet = 0; packet < slice.packets.size(); ++packet) {
+      decoder_->replay(slice, packet);
+      onPacketDecoded(frame_id, sector_count);
+    }
+  }
+}
+
+void PandarCloud::onPacketDecoded(const std::string& frame_id, uint16_t sector_count)
+{
+  if (sector_count > 0) {
+    collectSector();
+  }
+  if (decoder_->hasScanned()) {
+    publishPointcloud(frame_id);
+  }
+}
+
+void PandarCloud::publishPointcloud(const std::string& frame_id)
+{
+  PointcloudXYZIRADT pointcloud = decoder_->getPointcloud();
+  if (pointcloud->points.size() > 0) {
+    const ros::Time stamp(scanStartTime(*pointcloud));
+    pointcloud->header.stamp = pcl_conversions::toPCL(stamp);
+    pointcloud->header.frame_id = frame_id;
+
+    CloudJob job{ pointcloud, nullptr, nullptr, decoder_->getRangeImage(), decoder_->getIntensityImage(), received_,
+                  StageLatency::Clock::now() };
+    for (const auto& image : { job.range_image, job.intensity_image }) {
+      if (image) {
+        image->header.stamp = stamp;
+        image->header.frame_id = frame_id;
       }
     }
+    if (pipeline_) {
+      convert_queue_->push(std::move(job));
+      return;
+    }
+    serializeScan(job);
+    publishScan(job);
+  }
+  updater_.update();
+}
+
+// Write the scan straight into the messages of the topics that have subscribers, then let go of the
+// cloud so it returns to the pool before the messages are published.
+void PandarCloud::serializeScan(CloudJob& job)
+{
+  const bool points_ex = pandar_points_ex_pub_.getNumSubscribers() > 0;
+  const bool points = pandar_points_pub_.getNumSubscribers() > 0;
+  if (points_ex || points) {
+    cloud_writer_->write(*job.cloud, points_ex ? &job.points_ex : nullptr, points ? &job.points : nullptr);
+  }
+  job.cloud.reset();
+}
+
+void PandarCloud::publishScan(const CloudJob& job)
+{
+  if (job.points_ex) {
+    pandar_points_ex_pub_.publish(job.points_ex);
+  }
+  if (job.points) {
+    pandar_points_pub_.publish(job.points);
+  }
+  if (job.range_image && pandar_range_image_pub_.getNumSubscribers() > 0) {
+    pandar_range_image_pub_.publish(job.range_image);
   }
+  if (job.intensity_image && pandar_intensity_image_pub_.getNumSubscribers() > 0) {
+    pandar_intensity_image_pub_.publish(job.intensity_image);
+  }
+}
+
+void PandarCloud::checkCloudPool(diagnostic_updater::DiagnosticStatusWrapper& stat)
+{
+  // misses after warm-up mean subscribers hold on to more scans than the pool keeps idle
+  CloudPool::Stats pool_stats = decoder_->cloudPoolStats();
+  stat.add("hits", pool_stats.hits);
+  stat.add("misses", pool_stats.misses);
+  stat.add("discarded", pool_stats.discarded);
+  stat.add("idle", pool_stats.idle);
+  stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "OK");
 }
 
-pcl::PointCloud<PointXYZIR>::Ptr
-PandarCloud::convertPointcloud(const pcl::PointCloud<PointXYZIRADT>::ConstPtr& input_pointcloud)
+void PandarCloud::beginSector(uint16_t sector_count)
 {
-  pcl::PointCloud<PointXYZIR>::Ptr output_pointcloud(new pcl::PointCloud<PointXYZIR>);
-  output_pointcloud->reserve(input_pointcloud->points.size());
-  PointXYZIR point;
-  for (const auto& p : input_pointcloud->points) {
-    point.x = p.x;
-    point.y = p.y;
-    point.z = p.z;
-    point.intensity = p.intensity;
-    point.ring = p.ring;
-    output_pointcloud->points.push_back(point);
+  sector_pc_.reset();
+  // sectors are slices of the unorganized point stream
+  if (sector_count > 0 && !decoder_->isOrganized() && pandar_sector_points_pub_.getNumSubscribers() > 0) {
+    sector_pc_.reset(new pcl::PointCloud<PointXYZIRADT>);
+  }
+}
+
+// The decoder keeps filling its current cloud across messages, and hands over to a new one mid-packet when
+// a rotation completes. Follow that cloud and only take the points added since the last sector.
+void PandarCloud::collectSector()
+{
+  PointcloudXYZIRADT partial = decoder_->getPartialPointcloud();
+  if (partial != sector_source_) {
+    if (sector_source_) {
+      appendSectorPoints(*sector_source_);
+    }
+    sector_source_ = partial;
+    sector_published_ = 0;
+  }
+}
+
+void PandarCloud::appendSectorPoints(const pcl::PointCloud<PointXYZIRADT>& source)
+{
+  if (sector_pc_ && sector_published_ < source.points.size()) {
+    sector_pc_->points.insert(sector_pc_->points.end(), source.points.begin() + sector_published_,
+                              source.points.end());
+  }
+  sector_published_ = source.points.size();
+}
+
+void PandarCloud::publishSector(const std_msgs::Header& header, uint16_t sector_index, uint16_t sector_count)
+{
+  if (sector_source_) {
+    appendSectorPoints(*sector_source_);
+  }
+  if (!sector_pc_ || sector_pc_->points.empty()) {
+    return;
   }
+  sector_pc_->header.stamp = pcl_conversions::toPCL(ros::Time(sector_pc_->points[0].time_stamp));
+  sector_pc_->header.frame_id = header.frame_id;
+  sector_pc_->height = 1;
+  sector_pc_->width = sector_pc_->points.size();
 
-  output_pointcloud->header = input_pointcloud->header;
-  output_pointcloud->height = 1;
-  output_pointcloud->width = output_pointcloud->points.size();
-  return output_pointcloud;
+  pandar_msgs::PandarSectorCloudPtr sector_msg(new pandar_msgs::PandarSectorCloud);
+  sector_msg->header.stamp = ros::Time(sector_pc_->points[0].time_stamp);
+  sector_msg->header.frame_id = header.frame_id;
+  sector_msg->sector_index = sector_index;
+  sector_msg->sector_count = sector_count;
+  pcl::toROSMsg(*sector_pc_, sector_msg->cloud);
+  pandar_sector_points_pub_.publish(sector_msg);
 }
 }  // namespace pandar_pointcloud
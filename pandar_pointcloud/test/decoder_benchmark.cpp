@@ -0,0 +1,622 @@
+// Decoder benchmarks on synthetic data, built with -DBUILD_DECODER_BENCHMARK=ON -DCMAKE_BUILD_TYPE=Release:
+//   rosrun pandar_pointcloud decoder_benchmark [section...]
+// Without arguments every section runs. Times are the best of several runs.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "pandar_pointcloud/calibration.hpp"
+#include "pandar_pointcloud/decode_pool.hpp"
+#include "pandar_pointcloud/decoder/pandar40_decoder.hpp"
+#include "pandar_pointcloud/decoder/pandar64_decoder.hpp"
+#include "pandar_pointcloud/decoder/pandar_128_e4x_decoder.hpp"
+#include "pandar_pointcloud/decoder/pandar_qt128_decoder.hpp"
+#include "pandar_pointcloud/decoder/pandar_qt_decoder.hpp"
+#include "pandar_pointcloud/decoder/pandar_xt_decoder.hpp"
+#include "pandar_pointcloud/decoder/pandar_xtm_decoder.hpp"
+#include "pandar_pointcloud/decoder/trig_table.hpp"
+#include "pandar_pointcloud/decoder/unit_vector_table.hpp"
+#include "synthetic_packets.hpp"
+
+using namespace pandar_pointcloud;
+using test::PacketStream;
+
+namespace
+{
+constexpr size_t RUNS = 15;
+constexpr size_t POINTS = 1 << 20;
+
+// point coordinates the loops write, as a decoder fills its cloud
+struct Points
+{
+  Points() : x(POINTS), y(POINTS), z(POINTS)
+  {
+  }
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+};
+
+// keeps the optimizer from dropping the loops
+volatile float sink;
+
+// best time of runs calls of run(), in ns
+template <class Run>
+double bestOf(size_t runs, Run run)
+{
+  double best = 1e300;
+  for (size_t i = 0; i < runs; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+// Calibration and returns of a sensor with the given channel count: one firing of every channel per
+// azimuth, 0.2 degrees apart.
+struct Firings
+{
+  explicit Firings(size_t channels) : channels(channels)
+  {
+    std::mt19937 random(7);
+    for (size_t channel = 0; channel < channels; ++channel) {
+      elev_angle.push_back(15.0f - 40.0f * channel / channels);
+      // calibration files give offsets in 0.001 degrees
+      azimuth_offset.push_back(static_cast<int>(random() % 8000) / 1000.0f - 4.0f);
+    }
+    for (size_t point = 0; point < POINTS; ++point) {
+      distance.push_back(0.4f + (random() % 40000) * 0.004f);
+    }
+  }
+  size_t count() const
+  {
+    return POINTS / channels;
+  }
+  static uint16_t azimuth(size_t firing)
+  {
+    return static_cast<uint16_t>(firing * 20 % 36000);
+  }
+
+  size_t channels;
+  std::vector<float> elev_angle;
+  std::vector<float> azimuth_offset;
+  std::vector<float> distance;
+};
+
+double deg2rad(double degrees)
+{
+  return degrees * M_PI / 180.0;
+}
+
+// per channel elevation sin/cos and azimuth offset in TrigTable steps, as the decoders precompute them
+struct ChannelTables
+{
+  explicit ChannelTables(const Firings& firings)
+  {
+    for (size_t channel = 0; channel < firings.channels; ++channel) {
+      cos_elev.push_back(cosf(deg2rad(firings.elev_angle[channel])));
+      sin_elev.push_back(sinf(deg2rad(firings.elev_angle[channel])));
+      offset_steps.push_back(TrigTable::toSteps(firings.azimuth_offset[channel]));
+    }
+  }
+
+  std::vector<float> cos_elev;
+  std::vector<float> sin_elev;
+  std::vector<int> offset_steps;
+};
+
+// the TrigTable point loop
+void lookupPoints(const Firings& firings, const ChannelTables& tables, Points& out)
+{
+  const TrigTable& table = TrigTable::instance();
+  const size_t channels = firings.channels;
+  for (size_t firing = 0; firing < firings.count(); ++firing) {
+    const size_t first = firing * channels;
+    for (size_t channel = 0; channel < channels; ++channel) {
+      const float distance = firings.distance[first + channel];
+      const int azimuth = Firings::azimuth(firing) + tables.offset_steps[channel];
+      const float xy = distance * tables.cos_elev[channel];
+      out.x[first + channel] = xy * table.sin(azimuth);
+      out.y[first + channel] = xy * table.cos(azimuth);
+      out.z[first + channel] = distance * tables.sin_elev[channel];
+    }
+  }
+}
+
+// Point math before the shared table: sinf/cosf of the calibrated angles for every point, against two
+// TrigTable lookups and per channel elevation sin/cos.
+void trig(const std::vector<size_t>& channel_counts)
+{
+  printf("trig: ns per point, sinf/cosf -> TrigTable\n");
+  for (size_t channels : channel_counts) {
+    const Firings firings(channels);
+    const ChannelTables tables(firings);
+    const size_t points = firings.count() * channels;
+    Points out;
+
+    const double direct = bestOf(RUNS, [&] {
+      for (size_t firing = 0; firing < firings.count(); ++firing) {
+        const size_t first = firing * channels;
+        for (size_t channel = 0; channel < channels; ++channel) {
+          const float distance = firings.distance[first + channel];
+          const double azimuth = firings.azimuth_offset[channel] + Firings::azimuth(firing) / 100.0;
+          const double xy = distance * cosf(deg2rad(firings.elev_angle[channel]));
+          out.x[first + channel] = static_cast<float>(xy * sinf(deg2rad(azimuth)));
+          out.y[first + channel] = static_cast<float>(xy * cosf(deg2rad(azimuth)));
+          out.z[first + channel] = static_cast<float>(distance * sinf(deg2rad(firings.elev_angle[channel])));
+        }
+      }
+    });
+    const double lookup = bestOf(RUNS, [&] { lookupPoints(firings, tables, out); });
+    sink = out.x[points - 1] + out.y[points - 1] + out.z[points - 1];
+    printf("  %3zu channels  %5.1f -> %4.1f  (%.1fx)\n", channels, direct / points, lookup / points,
+           direct / lookup);
+  }
+}
+
+// TrigTable lookups against distance * UnitVectorTable direction, at each table resolution in degrees.
+void unitVectors(const std::vector<size_t>& channel_counts, const std::vector<double>& resolutions)
+{
+  printf("unit_vectors: ns per point, TrigTable -> UnitVectorTable\n");
+  for (double resolution : resolutions) {
+    for (size_t channels : channel_counts) {
+      const Firings firings(channels);
+      const ChannelTables tables(firings);
+      const UnitVectorTable vectors(firings.elev_angle.data(), firings.azimuth_offset.data(), channels, resolution);
+      const size_t points = firings.count() * channels;
+      Points out;
+
+      const double lookup = bestOf(RUNS, [&] { lookupPoints(firings, tables, out); });
+      const double unit = bestOf(RUNS, [&] {
+        for (size_t firing = 0; firing < firings.count(); ++firing) {
+          const size_t first = firing * channels;
+          for (size_t channel = 0; channel < channels; ++channel) {
+            const float distance = firings.distance[first + channel];
+            const UnitVectorTable::Vector& direction = vectors.at(channel, Firings::azimuth(firing));
+            out.x[first + channel] = distance * direction.x;
+            out.y[first + channel] = distance * direction.y;
+            out.z[first + channel] = distance * direction.z;
+          }
+        }
+      });
+      sink = out.x[points - 1] + out.y[points - 1] + out.z[points - 1];
+      printf("  %.2f deg  %3zu channels  %5.1f MB  %4.1f -> %4.1f\n", resolution, channels,
+             vectors.bytes() / (1024.0 * 1024.0), lookup / points, unit / points);
+    }
+  }
+}
+
+// Decoding 2000 packets of a model, ten times per run. channels: the channel slots of one packet, valid or
+// not, which the figures are divided by.
+template <class Next>
+void unpackPackets(const char* model, const char* mode, PacketDecoder& decoder, size_t channels, Next next)
+{
+  constexpr size_t PACKETS = 2000;
+  constexpr size_t REPEATS = 10;
+  std::vector<std::vector<uint8_t>> packets;
+  for (size_t packet = 0; packet < PACKETS; ++packet) {
+    packets.push_back(next());
+  }
+  const double best = bestOf(RUNS, [&] {
+    for (size_t repeat = 0; repeat < REPEATS; ++repeat) {
+      for (const auto& packet : packets) {
+        decoder.unpack(packet.data(), packet.size());
+      }
+    }
+  });
+  printf("  %-6s %-9s %5.1f\n", model, mode, best / (REPEATS * PACKETS * channels));
+}
+
+enum class Mode
+{
+  DUAL,
+  STRONGEST,
+  LAST,
+};
+
+// what the return mode loops write for every point
+struct Returns
+{
+  Returns() : time_stamp(POINTS), return_type(POINTS), count(0)
+  {
+  }
+  Points points;
+  std::vector<double> time_stamp;
+  std::vector<uint8_t> return_type;
+  size_t count;
+};
+
+// The return mode handling of the P40, P64, QT and QT128 decoders on their packet layout, in two forms that
+// only differ in where they branch. branching() compares the configured mode for every channel and the
+// packet's return mode for every point, as the decoders did. selected() picks a converter once per packet,
+// instantiated per mode, as they do now.
+template <class Packet>
+class ReturnModeLoops
+{
+public:
+  static constexpr size_t BLOCKS = std::extent<decltype(Packet::blocks)>::value;
+  static constexpr size_t CHANNELS = std::extent<decltype(std::declval<Packet>().blocks[0].units)>::value;
+
+  ReturnModeLoops(Mode mode, uint8_t dual_code, uint8_t strongest_code)
+    : firings_(CHANNELS), tables_(firings_), mode_(mode), dual_code_(dual_code), strongest_code_(strongest_code)
+  {
+    for (size_t block = 0; block < BLOCKS; ++block) {
+      block_offset_single_.push_back(55.56f * (BLOCKS - block - 1));
+      block_offset_dual_.push_back(55.56f * ((BLOCKS - block - 1) / 2));
+    }
+    for (size_t channel = 0; channel < CHANNELS; ++channel) {
+      firing_offset_.push_back(1.5f * channel);
+    }
+  }
+
+  void branching(const Packet& packet, Returns& out) const
+  {
+    const bool dual = packet.tail.return_mode == dual_code_;
+    for (size_t block = 0; block < BLOCKS; block += dual ? 2 : 1) {
+      if (dual) {
+        for (size_t channel = 0; channel < CHANNELS; ++channel) {
+          convertChannel<false, Mode::DUAL>(packet, block, channel, out);
+        }
+      }
+      else {
+        for (size_t channel = 0; channel < CHANNELS; ++channel) {
+          emit<false, false>(packet, block, channel,
+                             packet.tail.return_mode == strongest_code_ ? SINGLE_STRONGEST : SINGLE_LAST, out);
+        }
+      }
+    }
+  }
+
+  void selected(const Packet& packet, Returns& out) const
+  {
+    const bool dual = packet.tail.return_mode == dual_code_;
+    const Convert convert = select(dual);
+    for (size_t block = 0; block < BLOCKS; block += dual ? 2 : 1) {
+      (this->*convert)(packet, block, out);
+    }
+  }
+
+private:
+  using Convert = void (ReturnModeLoops::*)(const Packet&, size_t, Returns&) const;
+  enum ReturnType : uint8_t
+  {
+    SINGLE_STRONGEST = 1,
+    SINGLE_LAST,
+    DUAL_STRONGEST_FIRST,
+    DUAL_STRONGEST_LAST,
+    DUAL_WEAK_FIRST,
+    DUAL_WEAK_LAST,
+    DUAL_ONLY,
+  };
+
+  Convert select(bool dual) const
+  {
+    if (!dual) {
+      return &ReturnModeLoops::convert;
+    }
+    switch (mode_) {
+      case Mode::STRONGEST:
+        return &ReturnModeLoops::convertDual<Mode::STRONGEST>;
+      case Mode::LAST:
+        return &ReturnModeLoops::convertDual<Mode::LAST>;
+      default:
+        return &ReturnModeLoops::convertDual<Mode::DUAL>;
+    }
+  }
+
+  void convert(const Packet& packet, size_t block, Returns& out) const
+  {
+    const uint8_t return_type = packet.tail.return_mode == strongest_code_ ? SINGLE_STRONGEST : SINGLE_LAST;
+    for (size_t channel = 0; channel < CHANNELS; ++channel) {
+      emit<true, false>(packet, block, channel, return_type, out);
+    }
+  }
+
+  template <Mode M>
+  void convertDual(const Packet& packet, size_t block, Returns& out) const
+  {
+    for (size_t channel = 0; channel < CHANNELS; ++channel) {
+      convertChannel<true, M>(packet, block, channel, out);
+    }
+  }
+
+  // Selected: the mode is M, otherwise mode_ is read for every channel.
+  template <bool Selected, Mode M>
+  void convertChannel(const Packet& packet, size_t block, size_t channel, Returns& out) const
+  {
+    const Mode mode = Selected ? M : mode_;
+    const auto& even = packet.blocks[block].units[channel];
+    const auto& odd = packet.blocks[block + 1].units[channel];
+    const float even_distance = even.distance * DISTANCE_UNIT;
+    const float odd_distance = odd.distance * DISTANCE_UNIT;
+    const bool even_usable = even_distance > 0.1f && even_distance <= 200.0f;
+    const bool odd_usable = odd_distance > 0.1f && odd_distance <= 200.0f;
+    if (mode == Mode::STRONGEST) {
+      if (even.intensity >= odd.intensity && even_usable) {
+        emit<Selected, true>(packet, block, channel, SINGLE_STRONGEST, out);
+      }
+      else if (even.intensity < odd.intensity && odd_usable) {
+        emit<Selected, true>(packet, block + 1, channel, SINGLE_STRONGEST, out);
+      }
+    }
+    else if (mode == Mode::LAST && even_usable) {
+      emit<Selected, true>(packet, block, channel, SINGLE_LAST, out);
+    }
+    else if (mode == Mode::DUAL) {
+      if (std::abs(even_distance - odd_distance) < 0.1f && even_usable) {
+        emit<Selected, true>(packet, block, channel, DUAL_ONLY, out);
+      }
+      else if (even.intensity >= odd.intensity) {
+        if (odd_usable) {
+          emit<Selected, true>(packet, block + 1, channel, DUAL_WEAK_FIRST, out);
+        }
+        if (even_usable) {
+          emit<Selected, true>(packet, block, channel, DUAL_STRONGEST_LAST, out);
+        }
+      }
+      else {
+        if (odd_usable) {
+          emit<Selected, true>(packet, block + 1, channel, DUAL_STRONGEST_FIRST, out);
+        }
+        if (even_usable) {
+          emit<Selected, true>(packet, block, channel, DUAL_WEAK_LAST, out);
+        }
+      }
+    }
+  }
+
+  // Selected: the block offsets are those of Dual, otherwise the packet's return mode picks them per point.
+  template <bool Selected, bool Dual>
+  void emit(const Packet& packet, size_t block, size_t channel, uint8_t return_type, Returns& out) const
+  {
+    const bool dual = Selected ? Dual : packet.tail.return_mode == dual_code_;
+    const float block_offset = dual ? block_offset_dual_[block] : block_offset_single_[block];
+    const float distance = packet.blocks[block].units[channel].distance * DISTANCE_UNIT;
+    const int azimuth = packet.blocks[block].azimuth + tables_.offset_steps[channel];
+    const float xy = distance * tables_.cos_elev[channel];
+    const size_t n = out.count++;
+    out.points.x[n] = xy * trig_.sin(azimuth);
+    out.points.y[n] = xy * trig_.cos(azimuth);
+    out.points.z[n] = distance * tables_.sin_elev[channel];
+    out.time_stamp[n] = PACKET_TIME - static_cast<double>(block_offset + firing_offset_[channel]) / 1000000.0;
+    out.return_type[n] = return_type;
+  }
+
+  static constexpr float DISTANCE_UNIT = 0.004f;
+  static constexpr double PACKET_TIME = 1652782272.0;
+
+  const TrigTable& trig_ = TrigTable::instance();
+  Firings firings_;
+  ChannelTables tables_;
+  Mode mode_;
+  uint8_t dual_code_;
+  uint8_t strongest_code_;
+  std::vector<float> block_offset_single_;
+  std::vector<float> block_offset_dual_;
+  std::vector<float> firing_offset_;
+};
+
+// 2000 packets of a model through both loops, ns per channel slot
+template <class Packet, class Next>
+void returnModePackets(const char* model, const char* mode_name, const ReturnModeLoops<Packet>& loops, Next next)
+{
+  constexpr size_t PACKETS = 2000;
+  std::vector<Packet> packets(PACKETS);
+  for (auto& packet : packets) {
+    const std::vector<uint8_t> bytes = next();
+    std::memcpy(&packet, bytes.data(), sizeof(Packet));
+  }
+  // the two loops take turns so both see the same load on the machine
+  Returns out;
+  double branching = 1e300;
+  double selected = 1e300;
+  size_t branching_count = 0;
+  for (size_t run = 0; run < RUNS; ++run) {
+    branching = std::min(branching, bestOf(1, [&] {
+                           out.count = 0;
+                           for (const auto& packet : packets) {
+                             loops.branching(packet, out);
+                           }
+                         }));
+    branching_count = out.count;
+    selected = std::min(selected, bestOf(1, [&] {
+                          out.count = 0;
+                          for (const auto& packet : packets) {
+                            loops.selected(packet, out);
+                          }
+                        }));
+  }
+  if (out.count != branching_count) {
+    printf("  %s %s: the loops disagree, %zu and %zu points\n", model, mode_name, branching_count, out.count);
+  }
+  const double slots = PACKETS * ReturnModeLoops<Packet>::BLOCKS * ReturnModeLoops<Packet>::CHANNELS;
+  printf("  %-6s %-9s %5.1f -> %4.1f  (%.2fx)\n", model, mode_name, branching / slots, selected / slots,
+         branching / selected);
+}
+
+// The return mode branches of P40, P64, QT and QT128: per point against once per packet.
+void returnMode()
+{
+  printf("return_mode: ns per channel, branching per point -> converter selected per packet\n");
+  {
+    using namespace pandar40;
+    PacketStream stream(0, 20);
+    returnModePackets("P40", "strongest", ReturnModeLoops<Packet>(Mode::STRONGEST, DUAL_RETURN, STRONGEST_RETURN),
+                      [&] { return stream.pandar40(STRONGEST_RETURN); });
+    returnModePackets("P40", "dual", ReturnModeLoops<Packet>(Mode::DUAL, DUAL_RETURN, STRONGEST_RETURN),
+                      [&] { return stream.pandar40(DUAL_RETURN); });
+  }
+  {
+    using namespace pandar64;
+    PacketStream stream(0, 20);
+    returnModePackets("P64", "strongest", ReturnModeLoops<Packet>(Mode::STRONGEST, DUAL_RETURN, STRONGEST_RETURN),
+                      [&] { return stream.pandar64(STRONGEST_RETURN); });
+    returnModePackets("P64", "dual", ReturnModeLoops<Packet>(Mode::DUAL, DUAL_RETURN, STRONGEST_RETURN),
+                      [&] { return stream.pandar64(DUAL_RETURN); });
+  }
+  {
+    using namespace pandar_qt;
+    PacketStream stream(0, 60);
+    returnModePackets("QT", "first", ReturnModeLoops<Packet>(Mode::STRONGEST, DUAL_RETURN, FIRST_RETURN),
+                      [&] { return stream.qt(FIRST_RETURN); });
+    returnModePackets("QT", "dual", ReturnModeLoops<Packet>(Mode::DUAL, DUAL_RETURN, FIRST_RETURN),
+                      [&] { return stream.qt(DUAL_RETURN); });
+  }
+  {
+    using namespace pandar_qt128;
+    PacketStream stream(0, 40);
+    returnModePackets("QT128", "first", ReturnModeLoops<Packet>(Mode::STRONGEST, DUAL_RETURN, FIRST_RETURN),
+                      [&] { return stream.qt128(FIRST_RETURN); });
+    returnModePackets("QT128", "dual", ReturnModeLoops<Packet>(Mode::DUAL, DUAL_RETURN, FIRST_RETURN),
+                      [&] { return stream.qt128(DUAL_RETURN); });
+  }
+}
+
+// Calibration for the decoder sections: elevations 15 to -16.75 degrees, offsets repeating every 4 channels.
+Calibration benchmarkCalibration()
+{
+  Calibration calibration;
+  for (int channel = 0; channel < 128; ++channel) {
+    calibration.elev_angle_map[channel] = 15.0f - channel * 0.25f;
+    calibration.azimuth_offset_map[channel] = (channel % 4) * 1.5f - 2.25f;
+  }
+  return calibration;
+}
+
+// unpack() of every decoder on synthetic packets, in its single and dual return modes
+void unpack()
+{
+  printf("unpack: ns per channel\n");
+  Calibration calibration = benchmarkCalibration();
+  {
+    using namespace pandar40;
+    Pandar40Decoder single(calibration, 0.0f, 0.1, Pandar40Decoder::ReturnMode::STRONGEST);
+    Pandar40Decoder dual(calibration, 0.0f, 0.1, Pandar40Decoder::ReturnMode::DUAL);
+    PacketStream stream(0, 20);
+    unpackPackets("P40", "strongest", single, 400, [&] { return stream.pandar40(STRONGEST_RETURN); });
+    unpackPackets("P40", "dual", dual, 400, [&] { return stream.pandar40(DUAL_RETURN); });
+  }
+  {
+    using namespace pandar64;
+    Pandar64Decoder single(calibration, 0.0f, 0.1, Pandar64Decoder::ReturnMode::STRONGEST);
+    Pandar64Decoder dual(calibration, 0.0f, 0.1, Pandar64Decoder::ReturnMode::DUAL);
+    PacketStream stream(0, 20);
+    unpackPackets("P64", "strongest", single, 384, [&] { return stream.pandar64(STRONGEST_RETURN); });
+    unpackPackets("P64", "dual", dual, 384, [&] { return stream.pandar64(DUAL_RETURN); });
+  }
+  {
+    using namespace pandar_qt;
+    PandarQTDecoder single(calibration, 0.0f, 0.1, PandarQTDecoder::ReturnMode::FIRST);
+    PandarQTDecoder dual(calibration, 0.0f, 0.1, PandarQTDecoder::ReturnMode::DUAL);
+    PacketStream stream(0, 60);
+    unpackPackets("QT", "first", single, 256, [&] { return stream.qt(FIRST_RETURN); });
+    unpackPackets("QT", "dual", dual, 256, [&] { return stream.qt(DUAL_RETURN); });
+  }
+  {
+    using namespace pandar_xt;
+    PandarXTDecoder single(calibration, 0.0f, 0.1, PandarXTDecoder::ReturnMode::STRONGEST);
+    PandarXTDecoder dual(calibration, 0.0f, 0.1, PandarXTDecoder::ReturnMode::DUAL);
+    PacketStream stream(0, 18);
+    unpackPackets("XT", "strongest", single, 256, [&] { return stream.xt(STRONGEST_RETURN); });
+    unpackPackets("XT", "dual", dual, 256, [&] { return stream.xt(DUAL_RETURN); });
+  }
+  {
+    using namespace pandar_xtm;
+    PandarXTMDecoder single(calibration, 0.0f, 0.1, PandarXTMDecoder::ReturnMode::STRONGEST);
+    PandarXTMDecoder dual(calibration, 0.0f, 0.1, PandarXTMDecoder::ReturnMode::DUAL);
+    PacketStream stream(0, 18);
+    unpackPackets("XTM", "strongest", single, 256, [&] { return stream.xtm(STRONGEST_RETURN); });
+    unpackPackets("XTM", "dual", dual, 256, [&] { return stream.xtm(DUAL_RETURN); });
+  }
+  {
+    using namespace pandar_qt128;
+    PandarQT128Decoder single(calibration, 0.0f, 0.1, PandarQT128Decoder::ReturnMode::FIRST);
+    PandarQT128Decoder dual(calibration, 0.0f, 0.1, PandarQT128Decoder::ReturnMode::DUAL);
+    PacketStream stream(0, 40);
+    unpackPackets("QT128", "first", single, 256, [&] { return stream.qt128(FIRST_RETURN); });
+    unpackPackets("QT128", "dual", dual, 256, [&] { return stream.qt128(DUAL_RETURN); });
+  }
+  {
+    using namespace pandar_128_e4x;
+    Pandar128E4XDecoder single(calibration, 0.0f, 0.1, Pandar128E4XDecoder::ReturnMode::STRONGEST);
+    Pandar128E4XDecoder dual(calibration, 0.0f, 0.1, Pandar128E4XDecoder::ReturnMode::DUAL);
+    PacketStream stream(0, 10);
+    unpackPackets("128E4X", "strongest", single, 256, [&] { return stream.pandar128E4X(SINGLE_STRONGEST_RETURN); });
+    unpackPackets("128E4X", "dual", dual, 256, [&] { return stream.pandar128E4X(DUAL_LAST_STRONGEST_RETURN); });
+  }
+}
+
+// Rotation messages of QT128 dual return packets decoded on a DecodePool and replayed, as PandarCloud does with
+// decode_threads, against one thread. The speedup is bounded by the cores of the machine.
+void decodePool(const std::vector<size_t>& thread_counts)
+{
+  using namespace pandar_qt128;
+  constexpr size_t MESSAGES = 8;
+  // 0.4 degrees per packet
+  constexpr size_t PACKETS_PER_MESSAGE = 900;
+  printf("decode_pool: ns per packet of %zu packet messages, %u hardware threads\n", PACKETS_PER_MESSAGE,
+         std::thread::hardware_concurrency());
+  Calibration calibration = benchmarkCalibration();
+  PacketStream stream(0, 40);
+  std::vector<std::vector<uint8_t>> packets;
+  for (size_t packet = 0; packet < MESSAGES * PACKETS_PER_MESSAGE; ++packet) {
+    packets.push_back(stream.qt128(DUAL_RETURN, packet % 4));
+  }
+  std::vector<std::vector<DecodePool::Packet>> messages(MESSAGES);
+  for (size_t packet = 0; packet < packets.size(); ++packet) {
+    messages[packet / PACKETS_PER_MESSAGE].push_back({ packets[packet].data(), packets[packet].size() });
+  }
+
+  double single = 0.0;
+  for (size_t threads : thread_counts) {
+    PandarQT128Decoder decoder(calibration);
+    DecodePool pool(decoder, threads);
+    const double best = bestOf(RUNS, [&] {
+      for (const auto& message : messages) {
+        const size_t slice_count = pool.decode(message);
+        for (size_t i = 0; i < slice_count; ++i) {
+          const PacketDecoder::Slice& slice = pool.slice(i);
+          for (size_t packet = 0; packet < slice.packets.size(); ++packet) {
+            decoder.replay(slice, packet);
+          }
+        }
+      }
+    });
+    const double per_packet = best / packets.size();
+    single = single > 0.0 ? single : per_packet;
+    printf("  %zu threads  %6.0f  (%.1fx)\n", threads, per_packet, single / per_packet);
+  }
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  std::vector<std::string> sections(argv + 1, argv + argc);
+  auto selected = [&sections](const char* section) {
+    return sections.empty() || std::find(sections.begin(), sections.end(), section) != sections.end();
+  };
+  if (selected("trig")) {
+    trig({ 32, 40, 64, 128 });
+  }
+  if (selected("unit_vectors")) {
+    unitVectors({ 32, 64, 128 }, { 0.1, 0.01 });
+  }
+  if (selected("return_mode")) {
+    returnMode();
+  }
+  if (selected("unpack")) {
+    unpack();
+  }
+  if (selected("decode_pool")) {
+    decodePool({ 1, 2, 4, 8 });
+  }
+  return 0;
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "pandar_pointcloud/decoder/pandar40.hpp"
+#include "pandar_pointcloud/decoder/pandar64.hpp"
+#include "pandar_pointcloud/decoder/pandar_128_e4x.hpp"
+#include "pandar_pointcloud/decoder/pandar_qt.hpp"
+#include "pandar_pointcloud/decoder/pandar_qt128.hpp"
+#include "pandar_pointcloud/decoder/pandar_xt.hpp"
+#include "pandar_pointcloud/decoder/pandar_xtm.hpp"
+
+namespace pandar_pointcloud
+{
+namespace test
+{
+// Packet streams for the decoder tests and the benchmark, built on the wire layouts. Each call returns the
+// next packet of a sensor spinning by azimuth_step per firing; the returns of a dual (or triple) return
+// firing take consecutive blocks with the same azimuth. Only raw mt19937 draws are used: the standard fixes
+// their sequence, so pinned decoder output does not depend on the library.
+class PacketStream
+{
+public:
+  // azimuth_step: 0.01 degrees between firings. invalid_one_in: about one return in that many has no
+  // distance, 0 makes every return valid.
+  PacketStream(uint16_t azimuth, uint16_t azimuth_step, uint32_t invalid_one_in = 10, uint32_t seed = 7)
+    : azimuth_(azimuth), azimuth_step_(azimuth_step), invalid_one_in_(invalid_one_in), random_(seed),
+      timestamp_(0), seconds_(0)
+  {
+  }
+
+  std::vector<uint8_t> pandar40(uint8_t return_mode)
+  {
+    using namespace pandar40;
+    Packet packet;
+    std::memset(&packet, 0, sizeof(packet));
+    for (auto& block : packet.blocks) {
+      block.sob = 0xEEFF;
+    }
+    fillBlocks(packet.blocks, BLOCKS_PER_PACKET, return_mode == DUAL_RETURN ? 2 : 1);
+    packet.tail.return_mode = return_mode;
+    packet.tail.timestamp = nextTimestamp();
+    setDateTime(packet.tail.date_time);
+    return bytes(packet);
+  }
+
+  std::vector<uint8_t> pandar64(uint8_t return_mode)
+  {
+    using namespace pandar64;
+    Packet packet;
+    std::memset(&packet, 0, sizeof(packet));
+    packet.header.sob = 0xFFEE;
+    packet.header.chLaserNumber = UNIT_NUM;
+    packet.header.chBlockNumber = BLOCK_NUM;
+    packet.header.chDisUnit = 4;
+    fillBlocks(packet.blocks, BLOCK_NUM, return_mode == DUAL_RETURN ? 2 : 1);
+    packet.tail.return_mode = return_mode;
+    packet.tail.timestamp = nextTimestamp();
+    setDateTime(packet.tail.date_time);
+    return bytes(packet);
+  }
+
+  std::vector<uint8_t> qt(uint8_t return_mode)
+  {
+    using namespace pandar_qt;
+    Packet packet;
+    std::memset(&packet, 0, sizeof(packet));
+    packet.header.sob = 0xFFEE;
+    packet.header.chLaserNumber = UNIT_NUM;
+    packet.header.chBlockNumber = BLOCK_NUM;
+    packet.header.chDisUnit = 4;
+    fillBlocks(packet.blocks, BLOCK_NUM, return_mode == DUAL_RETURN ? 2 : 1);
+    packet.tail.return_mode = return_mode;
+    packet.tail.timestamp = nextTimestamp();
+    setDateTime(packet.tail.date_time);
+    return bytes(packet);
+  }
+
+  std::vector<uint8_t> xt(uint8_t return_mode)
+  {
+    using namespace pandar_xt;
+    Packet packet;
+    std::memset(&packet, 0, sizeof(packet));
+    packet.header.sob = 0xFFEE;
+    packet.header.chLaserNumber = UNIT_NUM;
+    packet.header.chBlockNumber = BLOCK_NUM;
+    packet.header.chDisUnit = 4;
+    fillBlocks(packet.blocks, BLOCK_NUM, return_mode == DUAL_RETURN ? 2 : 1);
+    packet.tail.return_mode = return_mode;
+    packet.tail.timestamp = nextTimestamp();
+    setDateTime(packet.tail.date_time);
+    return bytes(packet);
+  }
+
+  std::vector<uint8_t> xtm(uint8_t return_mode)
+  {
+    using namespace pandar_xtm;
+    Packet packet;
+    std::memset(&packet, 0, sizeof(packet));
+    packet.header.sob = 0xFFEE;
+    packet.header.chLaserNumber = UNIT_NUM;
+    packet.header.chBlockNumber = PACKET_BLOCK_NUM;
+    packet.header.chDisUnit = 4;
+    const size_t returns = return_mode == TRIPLE_RETURN ? 3 : (return_mode >= DUAL_RETURN ? 2 : 1);
+    fillBlocks(packet.blocks, PACKET_BLOCK_NUM, returns);
+    packet.tail.return_mode = return_mode;
+    packet.tail.timestamp = nextTimestamp();
+    setDateTime(packet.tail.date_time);
+    return bytes(packet);
+  }
+
+  // mode_flag: the QT128 firing sequence bits of the tail
+  std::vector<uint8_t> qt128(uint8_t return_mode, uint8_t mode_flag = 0)
+  {
+    using namespace pandar_qt128;
+    Packet packet;
+    std::memset(&packet, 0, sizeof(packet));
+    packet.header.u16Sob = 0xFFEE;
+    packet.header.u8LaserNum = UNIT_NUM;
+    packet.header.u8BlockNum = BLOCK_NUM;
+    packet.header.u8DistUnit = 4;
+    packet.header.u8EchoNum = return_mode == DUAL_RETURN ? 2 : 1;
+    fillBlocks(packet.blocks, BLOCK_NUM, return_mode == DUAL_RETURN ? 2 : 1);
+    packet.tail.mode_flag = mode_flag;
+    packet.tail.return_mode = return_mode;
+    packet.tail.timestamp = nextTimestamp();
+    setDateTime(packet.tail.date_time);
+    return bytes(packet);
+  }
+
+  // two firings per packet, or the two returns of one firing in the dual return modes
+  std::vector<uint8_t> pandar128E4X(uint8_t return_mode)
+  {
+    using namespace pandar_128_e4x;
+    Packet packet;
+    std::memset(&packet, 0, sizeof(packet));
+    const bool dual = return_mode == DUAL_LAST_STRONGEST_RETURN || return_mode == DUAL_LAST_FIRST_RETURN ||
+                      return_mode == DUAL_FIRST_STRONGEST_RETURN;
+    packet.header.SOP = 0xFFEE;
+    packet.header.LaserNum = LASER_COUNT;
+    packet.header.BlockNum = 2;
+    packet.header.DistanceUnitMm = 4;
+    packet.header.ReturnNum = dual ? 2 : 1;
+    packet.body.azimuth_1 = azimuth_;
+    fillUnits(packet.body.block_01);
+    if (!dual) {
+      nextFiring();
+    }
+    packet.body.azimuth_2 = azimuth_;
+    fillUnits(packet.body.block_02);
+    nextFiring();
+    packet.tail.return_mode = return_mode;
+    packet.tail.timestamp_us = nextTimestamp();
+    setDateTime(&packet.tail.date_time.year);
+    return bytes(packet);
+  }
+
+  uint16_t azimuth() const
+  {
+    return azimuth_;
+  }
+
+private:
+  template <class Block>
+  void fillBlocks(Block* blocks, size_t count, size_t returns)
+  {
+    for (size_t block = 0; block < count; ++block) {
+      blocks[block].azimuth = azimuth_;
+      fillUnits(blocks[block].units);
+      if (block % returns == returns - 1) {
+        nextFiring();
+      }
+    }
+  }
+
+  template <class Unit, size_t N>
+  void fillUnits(Unit (&units)[N])
+  {
+    for (auto& unit : units) {
+      unit.distance = distance();
+      setIntensity(unit, static_cast<uint8_t>(random_()));
+    }
+  }
+  template <class Unit>
+  static auto setIntensity(Unit& unit, uint8_t value) -> decltype(unit.intensity = value, void())
+  {
+    unit.intensity = value;
+  }
+  static void setIntensity(pandar_128_e4x::Block& unit, uint8_t value)
+  {
+    unit.reflectivity = value;
+  }
+
+  // counts of 4 mm, from 0.4 to 160 m
+  uint16_t distance()
+  {
+    const uint32_t draw = random_();
+    if (invalid_one_in_ > 0 && draw % invalid_one_in_ == 0) {
+      return 0;
+    }
+    return static_cast<uint16_t>(100 + (draw >> 8) % 40000);
+  }
+
+  void nextFiring()
+  {
+    azimuth_ = static_cast<uint16_t>((azimuth_ + azimuth_step_) % 36000);
+  }
+
+  // packets 555 us apart from 2022-05-17 10:11:12, the date and time holds the second of the last timestamp
+  uint32_t nextTimestamp()
+  {
+    timestamp_ += 555;
+    if (timestamp_ >= 1000000) {
+      timestamp_ -= 1000000;
+      ++seconds_;
+    }
+    return timestamp_;
+  }
+  void setDateTime(uint8_t* date_time) const
+  {
+    const uint8_t utc[6] = { 22, 5, 17, 10, static_cast<uint8_t>(11 + (12 + seconds_) / 60),
+                             static_cast<uint8_t>((12 + seconds_) % 60) };
+    std::memcpy(date_time, utc, sizeof(utc));
+  }
+
+  template <class Packet>
+  static std::vector<uint8_t> bytes(const Packet& packet)
+  {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(&packet);
+    return std::vector<uint8_t>(data, data + sizeof(packet));
+  }
+
+  uint16_t azimuth_;
+  uint16_t azimuth_step_;
+  uint32_t invalid_one_in_;
+  std::mt19937 random_;
+  uint32_t timestamp_;
+  uint32_t seconds_;
+};
+}  // namespace test
+}  // namespace pandar_pointcloud
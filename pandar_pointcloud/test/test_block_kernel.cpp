@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "pandar_pointcloud/decoder/block_kernel.hpp"
+#include "pandar_pointcloud/decoder/trig_table.hpp"
+
+using namespace pandar_pointcloud;
+
+namespace
+{
+// a calibration of 128 channels and blocks of random distance records, 3 bytes (Pandar40, 64, 128E4X) and
+// 4 bytes (QT, XT, QT128) apart
+class BlockKernelTest : public testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    std::uniform_real_distribution<float> elevation(-25.0f, 15.0f);
+    std::uniform_real_distribution<float> offset(-4.0f, 4.0f);
+    for (size_t channel = 0; channel < BLOCK_KERNEL_CHANNELS; ++channel) {
+      elev_angle_[channel] = elevation(random_);
+      // calibration files give offsets in 0.001 degrees
+      azimuth_offset_[channel] = std::round(offset(random_) * 1000.0f) / 1000.0f;
+      const double elev = elev_angle_[channel] * M_PI / 180.0;
+      tables_.cos_elev[channel] = cosf(elev);
+      tables_.sin_elev[channel] = sinf(elev);
+      tables_.azimuth_offset[channel] = TrigTable::wrap(TrigTable::toSteps(azimuth_offset_[channel]));
+    }
+  }
+
+  void fillRecords(std::vector<uint8_t>& records)
+  {
+    std::uniform_int_distribution<int> byte(0, 0xff);
+    for (auto& value : records) {
+      value = static_cast<uint8_t>(byte(random_));
+    }
+  }
+
+  std::mt19937 random_{ 20 };
+  float elev_angle_[BLOCK_KERNEL_CHANNELS];
+  float azimuth_offset_[BLOCK_KERNEL_CHANNELS];
+  BlockKernelTables tables_;
+};
+
+uint16_t distanceCount(const uint8_t* record)
+{
+  return static_cast<uint16_t>(record[0] | (record[1] << 8));
+}
+}  // namespace
+
+TEST_F(BlockKernelTest, VariantsMatchScalarBitForBit)
+{
+  const std::vector<BlockKernel::Variant> variants = BlockKernel::variants();
+  ASSERT_STREQ(variants.front().name, "scalar");
+  std::vector<uint8_t> records(BLOCK_KERNEL_CHANNELS * 4 + 2);
+  BlockKernelOutput expected;
+  BlockKernelOutput actual;
+
+  for (const auto& variant : variants) {
+    SCOPED_TRACE(variant.name);
+    for (int azimuth = 0; azimuth < 36000; azimuth += 37) {
+      fillRecords(records);
+      for (size_t stride : { 3, 4 }) {
+        for (size_t channels : { 32, 40, 64, 128 }) {
+          for (bool horizontal_range : { false, true }) {
+            const BlockKernelParams params{ 0.004f, 0.1005f, 200.0005f, horizontal_range };
+            const size_t count =
+                variants.front().function(records.data(), stride, channels, azimuth, params, tables_, expected);
+            ASSERT_EQ(variant.function(records.data(), stride, channels, azimuth, params, tables_, actual), count);
+            const size_t bytes = count * sizeof(float);
+            ASSERT_EQ(std::memcmp(expected.x, actual.x, bytes), 0) << "azimuth " << azimuth;
+            ASSERT_EQ(std::memcmp(expected.y, actual.y, bytes), 0) << "azimuth " << azimuth;
+            ASSERT_EQ(std::memcmp(expected.z, actual.z, bytes), 0) << "azimuth " << azimuth;
+            ASSERT_EQ(std::memcmp(expected.distance, actual.distance, bytes), 0) << "azimuth " << azimuth;
+            ASSERT_EQ(std::memcmp(expected.channel, actual.channel, count * sizeof(int32_t)), 0)
+                << "azimuth " << azimuth;
+          }
+        }
+      }
+    }
+  }
+}
+
+// Against the per-point double precision math the decoders used before the kernel. The kernel rounds the
+// calibrated azimuth offset to the 0.01 degree table steps, at most 0.005 degrees of arc; everything else
+// is float rounding.
+TEST_F(BlockKernelTest, MatchesDoublePrecisionPath)
+{
+  const double distance_unit = 0.004;
+  const double offset_rounding = 0.005 * M_PI / 180.0;
+  const BlockKernelParams params{ static_cast<float>(distance_unit), 0.1005f, 200.0005f, false };
+  std::vector<uint8_t> records(BLOCK_KERNEL_CHANNELS * 4 + 2);
+  BlockKernelOutput output;
+
+  for (const auto& variant : BlockKernel::variants()) {
+    SCOPED_TRACE(variant.name);
+    size_t points = 0;
+    for (int azimuth = 0; azimuth < 36000; azimuth += 11) {
+      fillRecords(records);
+      const size_t count = variant.function(records.data(), 4, BLOCK_KERNEL_CHANNELS, azimuth, params, tables_, output);
+      size_t n = 0;
+      for (size_t channel = 0; channel < BLOCK_KERNEL_CHANNELS; ++channel) {
+        const double distance = distanceCount(&records[channel * 4]) * distance_unit;
+        if (!(distance > 0.1 && distance <= 200.0)) {
+          continue;
+        }
+        ASSERT_LT(n, count);
+        ASSERT_EQ(output.channel[n], static_cast<int32_t>(channel));
+
+        const double elev = elev_angle_[channel] * M_PI / 180.0;
+        const double azimuth_rad = (azimuth_offset_[channel] + azimuth * 1e-02) * M_PI / 180.0;
+        const double xy_distance = distance * cosf(elev);
+        const double x = static_cast<float>(xy_distance * sinf(azimuth_rad));
+        const double y = static_cast<float>(xy_distance * cosf(azimuth_rad));
+        const double z = static_cast<float>(distance * sinf(elev));
+        const double tolerance = distance * (offset_rounding + 4e-7) + 1e-6;
+        EXPECT_NEAR(output.distance[n], distance, distance * 2e-7);
+        EXPECT_NEAR(output.x[n], x, tolerance) << "channel " << channel << " azimuth " << azimuth;
+        EXPECT_NEAR(output.y[n], y, tolerance) << "channel " << channel << " azimuth " << azimuth;
+        EXPECT_NEAR(output.z[n], z, distance * 4e-7 + 1e-6) << "channel " << channel << " azimuth " << azimuth;
+        ++n;
+      }
+      ASSERT_EQ(n, count);
+      points += count;
+    }
+    EXPECT_GT(points, 0u);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
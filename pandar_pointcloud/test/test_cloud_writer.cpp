@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "pandar_pointcloud/cloud_writer.hpp"
+
+using namespace pandar_pointcloud;
+
+namespace
+{
+// A scan of width x height points. Organized scans have NaN cells, as the decoder grid leaves them.
+// Points are zeroed first so the padding pcl::toROSMsg copies is defined.
+pcl::PointCloud<PointXYZIRADT> testCloud(uint32_t width, uint32_t height)
+{
+  pcl::PointCloud<PointXYZIRADT> cloud;
+  cloud.points.resize(width * height);
+  for (size_t i = 0; i < cloud.points.size(); ++i) {
+    PointXYZIRADT& point = cloud.points[i];
+    std::memset(&point, 0, sizeof(point));
+    const bool missing = height > 1 && i % 7 == 3;
+    point.x = missing ? std::numeric_limits<float>::quiet_NaN() : 0.5f * i;
+    point.y = missing ? std::numeric_limits<float>::quiet_NaN() : -0.25f * i;
+    point.z = missing ? std::numeric_limits<float>::quiet_NaN() : 0.125f * i;
+    point.intensity = static_cast<float>(i % 256);
+    point.ring = static_cast<uint16_t>(height > 1 ? i / width : i % 64);
+    point.azimuth = static_cast<float>(i % 36000);
+    point.distance = missing ? std::numeric_limits<float>::quiet_NaN() : 0.75f * i;
+    point.return_type = static_cast<uint8_t>(i % 4);
+    point.time_stamp = 1652782272.0 + i * 1e-6;
+  }
+  cloud.width = width;
+  cloud.height = height;
+  cloud.is_dense = height == 1;
+  cloud.header.frame_id = "pandar";
+  cloud.header.stamp = 1652782272000000;
+  return cloud;
+}
+
+// pandar_points as published through pcl_ros before CloudWriter
+pcl::PointCloud<PointXYZIR> toXYZIR(const pcl::PointCloud<PointXYZIRADT>& input)
+{
+  pcl::PointCloud<PointXYZIR> output;
+  PointXYZIR point;
+  std::memset(&point, 0, sizeof(point));
+  for (const auto& p : input.points) {
+    point.x = p.x;
+    point.y = p.y;
+    point.z = p.z;
+    point.intensity = p.intensity;
+    point.ring = p.ring;
+    output.points.push_back(point);
+  }
+  output.header = input.header;
+  output.width = input.width;
+  output.height = input.height;
+  output.is_dense = input.is_dense;
+  return output;
+}
+
+void expectSameMessage(const sensor_msgs::PointCloud2& msg, const sensor_msgs::PointCloud2& expected)
+{
+  EXPECT_EQ(msg.header.frame_id, expected.header.frame_id);
+  ASSERT_EQ(msg.fields.size(), expected.fields.size());
+  for (size_t i = 0; i < msg.fields.size(); ++i) {
+    SCOPED_TRACE(expected.fields[i].name);
+    EXPECT_EQ(msg.fields[i].name, expected.fields[i].name);
+    EXPECT_EQ(msg.fields[i].offset, expected.fields[i].offset);
+    EXPECT_EQ(msg.fields[i].datatype, expected.fields[i].datatype);
+    EXPECT_EQ(msg.fields[i].count, expected.fields[i].count);
+  }
+  EXPECT_EQ(msg.point_step, expected.point_step);
+  EXPECT_EQ(msg.row_step, expected.row_step);
+  EXPECT_EQ(msg.width, expected.width);
+  EXPECT_EQ(msg.height, expected.height);
+  EXPECT_EQ(msg.is_bigendian, expected.is_bigendian);
+  EXPECT_EQ(msg.is_dense, expected.is_dense);
+  ASSERT_EQ(msg.data.size(), expected.data.size());
+  EXPECT_EQ(std::memcmp(msg.data.data(), expected.data.data(), msg.data.size()), 0);
+}
+}  // namespace
+
+// Both layouts must serialise exactly as pcl::toROSMsg did, for unorganized and organized scans, and
+// messages recycled from a scan of another size must not keep anything of it.
+TEST(CloudWriter, MatchesToROSMsg)
+{
+  std::shared_ptr<CloudWriter> writer = CloudWriter::create();
+  const uint32_t sizes[][2] = { { 1000, 1 }, { 180, 32 }, { 3000, 1 }, { 90, 32 } };
+  for (const auto& size : sizes) {
+    SCOPED_TRACE(testing::Message() << size[0] << "x" << size[1]);
+    const pcl::PointCloud<PointXYZIRADT> cloud = testCloud(size[0], size[1]);
+
+    sensor_msgs::PointCloud2Ptr points_ex;
+    sensor_msgs::PointCloud2Ptr points;
+    writer->write(cloud, &points_ex, &points);
+
+    sensor_msgs::PointCloud2 expected_ex;
+    pcl::toROSMsg(cloud, expected_ex);
+    expectSameMessage(*points_ex, expected_ex);
+
+    sensor_msgs::PointCloud2 expected;
+    pcl::toROSMsg(toXYZIR(cloud), expected);
+    expectSameMessage(*points, expected);
+  }
+}
+
+// One topic without subscribers is skipped, the other is still written in full.
+TEST(CloudWriter, SingleLayout)
+{
+  std::shared_ptr<CloudWriter> writer = CloudWriter::create();
+  const pcl::PointCloud<PointXYZIRADT> cloud = testCloud(180, 32);
+
+  sensor_msgs::PointCloud2Ptr points_ex;
+  writer->write(cloud, &points_ex, nullptr);
+  sensor_msgs::PointCloud2 expected_ex;
+  pcl::toROSMsg(cloud, expected_ex);
+  expectSameMessage(*points_ex, expected_ex);
+
+  sensor_msgs::PointCloud2Ptr points;
+  writer->write(cloud, nullptr, &points);
+  sensor_msgs::PointCloud2 expected;
+  pcl::toROSMsg(toXYZIR(cloud), expected);
+  expectSameMessage(*points, expected);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,625 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "pandar_pointcloud/calibration.hpp"
+#include "pandar_pointcloud/decode_pool.hpp"
+#include "pandar_pointcloud/decoder/pandar40_decoder.hpp"
+#include "pandar_pointcloud/decoder/pandar64_decoder.hpp"
+#include "pandar_pointcloud/decoder/pandar_128_e4x_decoder.hpp"
+#include "pandar_pointcloud/decoder/pandar_qt128_decoder.hpp"
+#include "pandar_pointcloud/decoder/pandar_qt_decoder.hpp"
+#include "pandar_pointcloud/decoder/pandar_xt_decoder.hpp"
+#include "pandar_pointcloud/decoder/pandar_xtm_decoder.hpp"
+#include "synthetic_packets.hpp"
+
+using namespace pandar_pointcloud;
+using test::PacketStream;
+
+namespace
+{
+// Unpack packets in order and return the size of every scan split off on the way.
+std::vector<size_t> scanSizes(PacketDecoder& decoder, const std::vector<std::vector<uint8_t>>& packets)
+{
+  std::vector<size_t> sizes;
+  for (const auto& packet : packets) {
+    decoder.unpack(packet.data(), packet.size());
+    if (decoder.hasScanned()) {
+      sizes.push_back(decoder.getPointcloud()->points.size());
+    }
+  }
+  return sizes;
+}
+
+// Elevations 15 to -16.75 degrees, azimuth offsets of -2.25 to 2.25 degrees repeating every 4 channels.
+// QT128 ignores it and decodes with its built in angles.
+Calibration testCalibration()
+{
+  Calibration calibration;
+  for (int channel = 0; channel < 128; ++channel) {
+    calibration.elev_angle_map[channel] = 15.0f - channel * 0.25f;
+    calibration.azimuth_offset_map[channel] = (channel % 4) * 1.5f - 2.25f;
+  }
+  return calibration;
+}
+
+// The size of the first scan, split off mid rotation, and the full rotation after it.
+using Scans = std::pair<size_t, PointcloudXYZIRADT>;
+
+template <class Next>
+Scans decodeRotation(PacketDecoder& decoder, Next next)
+{
+  Scans scans(0, nullptr);
+  bool first = true;
+  for (size_t packets = 0; packets < 100000; ++packets) {
+    const std::vector<uint8_t> packet = next();
+    decoder.unpack(packet.data(), packet.size());
+    if (!decoder.hasScanned()) {
+      continue;
+    }
+    if (!first) {
+      scans.second = decoder.getPointcloud();
+      return scans;
+    }
+    scans.first = decoder.getPointcloud()->points.size();
+    first = false;
+  }
+  ADD_FAILURE() << "no full rotation";
+  return scans;
+}
+
+struct PinnedPoint
+{
+  size_t index;
+  uint16_t ring;
+  float azimuth;
+  uint8_t return_type;
+  float x;
+  float y;
+  float z;
+  double time_stamp;
+};
+
+void expectPinned(const PointcloudXYZIRADT& scan, size_t size, const std::vector<PinnedPoint>& pinned)
+{
+  ASSERT_TRUE(scan != nullptr);
+  ASSERT_EQ(scan->points.size(), size);
+  for (const auto& expected : pinned) {
+    SCOPED_TRACE(expected.index);
+    const PointXYZIRADT& point = scan->points[expected.index];
+    EXPECT_EQ(point.ring, expected.ring);
+    EXPECT_EQ(point.azimuth, expected.azimuth);
+    EXPECT_EQ(point.return_type, expected.return_type);
+    EXPECT_NEAR(point.x, expected.x, 1e-4);
+    EXPECT_NEAR(point.y, expected.y, 1e-4);
+    EXPECT_NEAR(point.z, expected.z, 1e-4);
+    EXPECT_NEAR(point.time_stamp, expected.time_stamp, 1e-7);
+  }
+}
+}  // namespace
+
+// Output of every model on synthetic packets starting at 350 degrees, pinned at four points of the first
+// full rotation: ring, azimuth, return type, position and time stamp.
+
+TEST(Pandar40Decoder, StrongestReturn)
+{
+  using namespace pandar40;
+  Calibration calibration = testCalibration();
+  Pandar40Decoder decoder(calibration, 0.0f, 0.1, Pandar40Decoder::ReturnMode::STRONGEST);
+  PacketStream stream(35000, 20);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.pandar40(STRONGEST_RETURN); });
+  EXPECT_EQ(scans.first, 2000u);
+  expectPinned(scans.second, 72000u, {
+    { 0, 7, 225, 1, 4.23816204f, 107.868423f, 25.419241f, 1652782272.002746820 },
+    { 24000, 7, 12225, 1, 125.622444f, -79.2618561f, 34.9759789f, 1652782272.036046743 },
+    { 48000, 7, 24225, 1, -106.78614f, -56.1829033f, 28.4125977f, 1652782272.069346905 },
+    { 71999, 3, 36205, 1, 3.44254851f, 96.1752777f, 24.4410534f, 1652782272.102642775 },
+  });
+}
+
+TEST(Pandar40Decoder, DualReturn)
+{
+  using namespace pandar40;
+  Calibration calibration = testCalibration();
+  Pandar40Decoder decoder(calibration);
+  PacketStream stream(35000, 20);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.pandar40(DUAL_RETURN); });
+  EXPECT_EQ(scans.first, 3594u);
+  expectPinned(scans.second, 128767u, {
+    { 0, 7, 225, 5, 5.38750744f, 137.121201f, 32.3126717f, 1652782272.005799532 },
+    { 42922, 34, 12075, 4, 8.8257246f, -5.25075483f, 1.17006838f, 1652782272.072436810 },
+    { 85844, 23, 24205, 6, -74.4646759f, -39.5102577f, 13.7287006f, 1652782272.138710022 },
+    { 128766, 3, 36205, 4, 3.21039176f, 89.6894608f, 22.7928104f, 1652782272.205317736 },
+  });
+}
+
+TEST(Pandar64Decoder, StrongestReturn)
+{
+  using namespace pandar64;
+  Calibration calibration = testCalibration();
+  Pandar64Decoder decoder(calibration, 0.0f, 0.1, Pandar64Decoder::ReturnMode::STRONGEST);
+  PacketStream stream(35000, 20);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.pandar64(STRONGEST_RETURN); });
+  EXPECT_EQ(scans.first, 2900u);
+  expectPinned(scans.second, 103549u, {
+    { 0, 0, -225, 1, -2.19417119f, 55.8453827f, 14.9752712f, 1652782272.005213499 },
+    { 34516, 10, 12075, 1, 38.6123924f, -22.9719601f, 9.96055126f, 1652782272.060740948 },
+    { 69032, 11, 24225, 1, -17.1030273f, -8.99833775f, 4.19602585f, 1652782272.116244793 },
+    { 103548, 63, 36205, 1, 3.05577922f, 85.370018f, -1.11827052f, 1652782272.171758413 },
+  });
+}
+
+TEST(Pandar64Decoder, DualReturn)
+{
+  using namespace pandar64;
+  Calibration calibration = testCalibration();
+  Pandar64Decoder decoder(calibration);
+  PacketStream stream(35000, 20);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.pandar64(DUAL_RETURN); });
+  EXPECT_EQ(scans.first, 5724u);
+  expectPinned(scans.second, 206176u, {
+    { 0, 0, -225, 3, -0.252409309f, 6.42424536f, 1.72269952f, 1652782272.009486675 },
+    { 68725, 36, 11775, 3, 28.5059624f, -14.9977121f, 3.38546801f, 1652782272.120496511 },
+    { 137450, 38, 24075, 3, -21.4062748f, -11.9880905f, 2.36240602f, 1652782272.231469870 },
+    { 206175, 63, 36205, 4, 2.97451282f, 83.0996552f, -1.08853078f, 1652782272.342531681 },
+  });
+}
+
+TEST(PandarQTDecoder, FirstReturn)
+{
+  using namespace pandar_qt;
+  Calibration calibration = testCalibration();
+  PandarQTDecoder decoder(calibration, 0.0f, 0.1, PandarQTDecoder::ReturnMode::FIRST);
+  PacketStream stream(35000, 60);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.qt(FIRST_RETURN); });
+  EXPECT_EQ(scans.first, 972u);
+  expectPinned(scans.second, 34536u, {
+    { 0, 0, -205, 1, -0.494104028f, 13.8038998f, 3.70111251f, 1652782272.002979755 },
+    { 11512, 61, 11885, 1, 132.656921f, -73.0795822f, -0.660849392f, 1652782272.030693054 },
+    { 23024, 2, 24095, 1, -44.1829109f, -24.5414162f, 13.0708389f, 1652782272.058483839 },
+    { 34535, 63, 36185, 1, 3.78182125f, 117.084915f, -1.53352487f, 1652782272.086197138 },
+  });
+}
+
+TEST(PandarQTDecoder, DualReturn)
+{
+  using namespace pandar_qt;
+  Calibration calibration = testCalibration();
+  PandarQTDecoder decoder(calibration);
+  PacketStream stream(35000, 60);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.qt(DUAL_RETURN); });
+  EXPECT_EQ(scans.first, 1963u);
+  expectPinned(scans.second, 68608u, {
+    { 0, 0, -205, 3, -4.82480478f, 134.791687f, 36.1404572f, 1652782272.005199909 },
+    { 22869, 60, 11735, 3, 33.9547462f, -17.5628929f, 0.0f, 1652782272.060660839 },
+    { 45738, 5, 23945, 3, -66.6093063f, -39.3142204f, 18.9264526f, 1652782272.116209984 },
+    { 68607, 63, 36185, 4, 4.74351311f, 146.858826f, -1.92349005f, 1652782272.171667099 },
+  });
+}
+
+TEST(PandarXTDecoder, StrongestReturn)
+{
+  using namespace pandar_xt;
+  Calibration calibration = testCalibration();
+  PandarXTDecoder decoder(calibration, 0.0f, 0.1, PandarXTDecoder::ReturnMode::STRONGEST);
+  PacketStream stream(35000, 18);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.xt(STRONGEST_RETURN); });
+  EXPECT_EQ(scans.first, 1623u);
+  expectPinned(scans.second, 57513u, {
+    { 0, 0, -217, 0, -4.96899605f, 131.136581f, 35.1631546f, 1652782272.004093647 },
+    { 19171, 20, 11771, 0, 3.49791265f, -1.83722413f, 0.696676493f, 1652782272.050288677 },
+    { 38342, 5, 23927, 0, -64.4214783f, -38.2963142f, 18.3388939f, 1652782272.096481085 },
+    { 57512, 31, 36215, 0, 4.59913301f, 122.505676f, 15.5956688f, 1652782272.142685652 },
+  });
+}
+
+TEST(PandarXTDecoder, DualReturn)
+{
+  using namespace pandar_xt;
+  Calibration calibration = testCalibration();
+  PandarXTDecoder decoder(calibration);
+  PacketStream stream(35000, 18);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.xt(DUAL_RETURN); });
+  EXPECT_EQ(scans.first, 3248u);
+  expectPinned(scans.second, 115110u, {
+    { 0, 0, -217, 0, -1.21426964f, 32.045742f, 8.59279251f, 1652782272.008178711 },
+    { 38370, 17, 11939, 0, 53.1170425f, -29.9177017f, 11.5741892f, 1652782272.100484371 },
+    { 76740, 28, 23759, 0, -133.428528f, -84.708992f, 22.2120285f, 1652782272.193035841 },
+    { 115109, 31, 36215, 0, 4.36601257f, 116.29612f, 14.8051577f, 1652782272.285320520 },
+  });
+}
+
+TEST(PandarXTMDecoder, StrongestReturn)
+{
+  using namespace pandar_xtm;
+  Calibration calibration = testCalibration();
+  PandarXTMDecoder decoder(calibration);
+  PacketStream stream(35000, 18);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.xtm(STRONGEST_RETURN); });
+  EXPECT_EQ(scans.first, 1623u);
+  expectPinned(scans.second, 57513u, {
+    { 0, 0, 8, 55, 0.178815588f, 128.067154f, 45.3510017f, 1652782272.005405903 },
+    { 19171, 20, 11996, 55, 3.4535501f, -1.99069464f, -0.4541713f, 1652782272.067022324 },
+    { 38342, 5, 24002, 55, -65.119606f, -37.5665169f, 17.3563232f, 1652782272.128680468 },
+    { 57512, 31, 35990, 55, -0.201630384f, 115.525574f, -43.8841171f, 1652782272.190313816 },
+  });
+}
+
+TEST(PandarXTMDecoder, DualReturn)
+{
+  using namespace pandar_xtm;
+  Calibration calibration = testCalibration();
+  PandarXTMDecoder decoder(calibration);
+  PacketStream stream(35000, 18);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.xtm(DUAL_RETURN); });
+  EXPECT_EQ(scans.first, 3248u);
+  expectPinned(scans.second, 115110u, {
+    { 0, 1, 8, 57, 0.198600829f, 142.237274f, 46.7652855f, 1652782272.010553837 },
+    { 38370, 1, 12014, 57, 48.881443f, -28.3811913f, 18.5839272f, 1652782272.134218931 },
+    { 76740, 25, 23984, 57, -104.570183f, -60.7636032f, -27.9218254f, 1652782272.256996632 },
+    { 115109, 31, 35990, 57, -0.191410184f, 109.669838f, -41.6597252f, 1652782272.380678654 },
+  });
+}
+
+TEST(PandarXTMDecoder, TripleReturn)
+{
+  using namespace pandar_xtm;
+  Calibration calibration = testCalibration();
+  PandarXTMDecoder decoder(calibration);
+  PacketStream stream(35000, 18);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.xtm(TRIPLE_RETURN); });
+  EXPECT_EQ(scans.first, 4840u);
+  expectPinned(scans.second, 172715u, {
+    { 0, 1, 8, 61, 0.19372493f, 138.745178f, 45.6171417f, 1652782272.016053677 },
+    { 57571, 25, 12014, 61, 54.0096169f, -31.358675f, -14.4184628f, 1652782272.200941801 },
+    { 115143, 6, 24002, 61, -18.0192184f, -10.3950157f, 4.30801344f, 1652782272.385748148 },
+    { 172714, 31, 35990, 61, -0.15270263f, 87.4920654f, -33.2351685f, 1652782272.570588827 },
+  });
+}
+
+TEST(PandarQT128Decoder, FirstReturn)
+{
+  using namespace pandar_qt128;
+  Calibration calibration = testCalibration();
+  PandarQT128Decoder decoder(calibration, 0.0f, 0.1, PandarQT128Decoder::ReturnMode::FIRST);
+  PacketStream stream(35000, 40);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.qt128(FIRST_RETURN); });
+  EXPECT_EQ(scans.first, 2900u);
+  expectPinned(scans.second, 103549u, {
+    { 0, 0, 1063, 1, 6.47869396f, 34.5186234f, -45.981205f, 1652782272.007335424 },
+    { 34516, 10, 12734, 1, 28.2959461f, -21.5869694f, -29.1750317f, 1652782272.090617180 },
+    { 69032, 11, 24723, 1, -14.3238602f, -6.01237297f, -12.237999f, 1652782272.173892498 },
+    { 103548, 127, 34897, 1, -9.92156982f, 50.8997498f, 67.8926086f, 1652782272.257124186 },
+  });
+}
+
+TEST(PandarQT128Decoder, DualReturn)
+{
+  using namespace pandar_qt128;
+  Calibration calibration = testCalibration();
+  PandarQT128Decoder decoder(calibration);
+  PacketStream stream(35000, 40);
+  // cycle through the four firing sequence flags
+  uint8_t packets = 0;
+  const Scans scans = decodeRotation(decoder, [&stream, &packets] { return stream.qt128(DUAL_RETURN, packets++ % 4); });
+  EXPECT_EQ(scans.first, 5703u);
+  expectPinned(scans.second, 206181u, {
+    { 0, 0, 1063, 3, 0.745284915f, 3.97089434f, -5.28950691f, 1652782272.014541149 },
+    { 68727, 32, 11367, 3, 55.1266518f, -24.1644897f, -19.9425201f, 1652782272.181068659 },
+    { 137454, 3, 24907, 3, -45.5656204f, -17.4271603f, -54.3214569f, 1652782272.347541094 },
+    { 206180, 127, 34897, 4, -9.65771198f, 49.5461006f, 66.0870514f, 1652782272.513535023 },
+  });
+}
+
+TEST(Pandar128E4XDecoder, StrongestReturn)
+{
+  using namespace pandar_128_e4x;
+  Calibration calibration = testCalibration();
+  Pandar128E4XDecoder decoder(calibration, 0.0f, 0.1, Pandar128E4XDecoder::ReturnMode::STRONGEST);
+  PacketStream stream(35000, 10);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.pandar128E4X(SINGLE_STRONGEST_RETURN); });
+  EXPECT_EQ(scans.first, 11514u);
+  expectPinned(scans.second, 414595u, {
+    { 0, 0, -2.25, 0, -0.354343861f, 9.01865292f, 2.41840529f, 1652782272.028305054 },
+    { 138198, 121, 119.15, 0, 114.356934f, -63.7810287f, -35.698597f, 1652782272.360749960 },
+    { 276396, 94, 240.75, 0, -15.0975151f, -8.45501423f, -2.5860734f, 1652782272.694304943 },
+    { 414594, 127, 362.15, 0, 4.4050045f, 117.334732f, -35.3386307f, 1652782273.026750088 },
+  });
+}
+
+TEST(Pandar128E4XDecoder, DualReturn)
+{
+  using namespace pandar_128_e4x;
+  Calibration calibration = testCalibration();
+  Pandar128E4XDecoder decoder(calibration);
+  PacketStream stream(35000, 10);
+  const Scans scans = decodeRotation(decoder, [&stream] { return stream.pandar128E4X(DUAL_LAST_STRONGEST_RETURN); });
+  EXPECT_EQ(scans.first, 23018u);
+  expectPinned(scans.second, 829386u, {
+    { 0, 0, -2.25, 0, -5.62733269f, 143.225174f, 38.4066772f, 1652782272.056055069 },
+    { 276462, 70, 120.75, 0, 57.6868439f, -34.3200684f, -2.93069959f, 1652782272.722054958 },
+    { 552924, 4, 237.75, 0, -23.7286472f, -14.9716616f, 6.99541426f, 1652782273.388055086 },
+    { 829385, 127, 362.15, 0, 3.11059022f, 82.8558197f, -24.9543419f, 1652782274.053499937 },
+  });
+}
+
+// The returns of an XTM firing sit in consecutive blocks with the same azimuth, the scan must only be split
+// where the azimuth wraps.
+TEST(PandarXTMDecoder, OneSplitPerRotation)
+{
+  using namespace pandar_xtm;
+  // 0.18 degree firings, 2000 per rotation
+  const size_t firings_per_rotation = 2000;
+  for (uint8_t return_mode : { STRONGEST_RETURN, DUAL_RETURN, DUAL_RETURN_B, DUAL_RETURN_C, TRIPLE_RETURN }) {
+    SCOPED_TRACE(static_cast<int>(return_mode));
+    const size_t returns = return_mode == TRIPLE_RETURN ? 3 : (return_mode == STRONGEST_RETURN ? 1 : 2);
+    const size_t firings_per_packet = PACKET_BLOCK_NUM / returns;
+
+    // from 1 degree, past the wrap three times
+    PacketStream stream(100, 18, 0);
+    std::vector<std::vector<uint8_t>> packets;
+    while (packets.size() * firings_per_packet < firings_per_rotation * 7 / 2) {
+      packets.push_back(stream.xtm(return_mode));
+    }
+
+    Calibration calibration;
+    PandarXTMDecoder decoder(calibration);
+    const std::vector<size_t> sizes = scanSizes(decoder, packets);
+    ASSERT_EQ(sizes.size(), 3u);
+    // the first scan started mid rotation
+    EXPECT_LT(sizes[0], firings_per_rotation * returns * UNIT_NUM);
+    EXPECT_EQ(sizes[1], firings_per_rotation * returns * UNIT_NUM);
+    EXPECT_EQ(sizes[2], firings_per_rotation * returns * UNIT_NUM);
+  }
+}
+
+// An organized grid set up for fewer returns widens to every return of a triple return firing, whether the
+// packets are unpacked in place or sliced on another decoder and replayed.
+TEST(PandarXTMDecoder, OrganizedTripleReturn)
+{
+  using namespace pandar_xtm;
+  const size_t columns = 2000;
+  const size_t returns = 3;
+  for (bool sliced : { false, true }) {
+    SCOPED_TRACE(sliced);
+    PacketStream stream(100, 18, 0);
+    Calibration calibration;
+    PandarXTMDecoder decoder(calibration);
+    decoder.setOrganized(0.18, 1);
+    std::shared_ptr<PacketDecoder> slicer = decoder.clone();
+    PacketDecoder::Slice slice;
+
+    std::vector<PointcloudXYZIRADT> scans;
+    while (scans.size() < 2) {
+      const std::vector<uint8_t> packet = stream.xtm(TRIPLE_RETURN);
+      if (sliced) {
+        slice.clear();
+        slicer->unpackSlice(packet.data(), packet.size(), slice);
+        decoder.replay(slice, 0);
+      }
+      else {
+        decoder.unpack(packet.data(), packet.size());
+      }
+      if (decoder.hasScanned()) {
+        scans.push_back(decoder.getPointcloud());
+      }
+    }
+
+    const PointcloudXYZIRADT& scan = scans[1];
+    ASSERT_EQ(scan->width, columns * returns);
+    ASSERT_EQ(scan->height, UNIT_NUM);
+    size_t valid = 0;
+    for (const auto& point : scan->points) {
+      valid += std::isfinite(point.x) ? 1 : 0;
+    }
+    EXPECT_EQ(valid, columns * returns * UNIT_NUM);
+    // the third return of the first firing, ring 5
+    const PointXYZIRADT& third = scan->points[5 * columns * returns + 2];
+    EXPECT_EQ(third.ring, 5);
+    EXPECT_TRUE(std::isfinite(third.x));
+  }
+}
+
+// The two blocks of a single return 128E4X packet are two firings and fill two columns, the two blocks of a
+// dual return packet share one column.
+TEST(Pandar128E4XDecoder, OrganizedFiringColumns)
+{
+  using namespace pandar_128_e4x;
+  const size_t columns = 3600;
+  for (uint8_t return_mode : { SINGLE_STRONGEST_RETURN, DUAL_LAST_STRONGEST_RETURN }) {
+    SCOPED_TRACE(static_cast<int>(return_mode));
+    const size_t returns = return_mode == DUAL_LAST_STRONGEST_RETURN ? 2 : 1;
+    PacketStream stream(100, 10, 0);
+    Calibration calibration;
+    Pandar128E4XDecoder decoder(calibration);
+    decoder.setOrganized(0.1, 1);
+
+    std::vector<PointcloudXYZIRADT> scans;
+    while (scans.size() < 2) {
+      const std::vector<uint8_t> packet = stream.pandar128E4X(return_mode);
+      decoder.unpack(packet.data(), packet.size());
+      if (decoder.hasScanned()) {
+        scans.push_back(decoder.getPointcloud());
+      }
+    }
+
+    const PointcloudXYZIRADT& scan = scans[1];
+    ASSERT_EQ(scan->width, columns * returns);
+    ASSERT_EQ(scan->height, LASER_COUNT);
+    for (size_t ring : { size_t(0), size_t(127) }) {
+      for (size_t column = 0; column < columns; ++column) {
+        for (size_t n = 0; n < returns; ++n) {
+          const PointXYZIRADT& point = scan->points[(ring * columns + column) * returns + n];
+          ASSERT_TRUE(std::isfinite(point.x)) << "ring " << ring << " column " << column << " return " << n;
+          ASSERT_NEAR(point.azimuth, column * 0.1f, 1e-3) << "ring " << ring << " return " << n;
+        }
+      }
+    }
+  }
+}
+
+// The 128E4X point distance is the horizontal range, its range image must still hold the slant range. Image
+// buffers are recycled: with no subscriber holding them, a scan reuses the buffer of the scan before last.
+TEST(Pandar128E4XDecoder, RangeImage)
+{
+  using namespace pandar_128_e4x;
+  const size_t columns = 3600;
+  for (bool sliced : { false, true }) {
+    SCOPED_TRACE(sliced);
+    PacketStream stream(100, 10, 0);
+    Calibration calibration = testCalibration();
+    Pandar128E4XDecoder decoder(calibration, 0.0f, 0.1, Pandar128E4XDecoder::ReturnMode::STRONGEST);
+    decoder.setOrganized(0.1, 1);
+    decoder.setImages(0.1, RangeImageEncoding::FLOAT_METERS, 0.0);
+    std::shared_ptr<PacketDecoder> slicer = decoder.clone();
+    PacketDecoder::Slice slice;
+
+    std::vector<const uint8_t*> buffers;
+    PointcloudXYZIRADT scan;
+    sensor_msgs::ImagePtr image;
+    while (buffers.size() < 3) {
+      const std::vector<uint8_t> packet = stream.pandar128E4X(SINGLE_STRONGEST_RETURN);
+      if (sliced) {
+        slice.clear();
+        slicer->unpackSlice(packet.data(), packet.size(), slice);
+        decoder.replay(slice, 0);
+      }
+      else {
+        decoder.unpack(packet.data(), packet.size());
+      }
+      if (decoder.hasScanned()) {
+        buffers.push_back(decoder.getRangeImage()->data.data());
+        if (buffers.size() == 2) {
+          scan = decoder.getPointcloud();
+          image = decoder.getRangeImage();
+        }
+      }
+    }
+    EXPECT_EQ(buffers[2], buffers[0]);
+
+    ASSERT_EQ(image->width, columns);
+    ASSERT_EQ(image->height, LASER_COUNT);
+    const float* ranges = reinterpret_cast<const float*>(image->data.data());
+    for (size_t pixel = 0; pixel < columns * LASER_COUNT; pixel += 97) {
+      const PointXYZIRADT& point = scan->points[pixel];
+      ASSERT_TRUE(std::isfinite(point.x)) << pixel;
+      const float range = std::sqrt(point.x * point.x + point.y * point.y + point.z * point.z);
+      EXPECT_NEAR(ranges[pixel], range, 1e-3 * range) << pixel;
+    }
+  }
+}
+
+namespace
+{
+bool sameFloat(double a, double b)
+{
+  return a == b || (std::isnan(a) && std::isnan(b));
+}
+
+void expectSameScan(const PointcloudXYZIRADT& scan, const PointcloudXYZIRADT& expected)
+{
+  ASSERT_EQ(scan->width, expected->width);
+  ASSERT_EQ(scan->height, expected->height);
+  ASSERT_EQ(scan->points.size(), expected->points.size());
+  for (size_t i = 0; i < scan->points.size(); ++i) {
+    const PointXYZIRADT& a = scan->points[i];
+    const PointXYZIRADT& b = expected->points[i];
+    ASSERT_TRUE(sameFloat(a.x, b.x) && sameFloat(a.y, b.y) && sameFloat(a.z, b.z) &&
+                sameFloat(a.distance, b.distance) && a.intensity == b.intensity && a.ring == b.ring &&
+                a.azimuth == b.azimuth && a.return_type == b.return_type && a.time_stamp == b.time_stamp)
+        << "point " << i;
+  }
+}
+}  // namespace
+
+// Messages decoded in slices on a DecodePool and replayed split into the same scans, point for point, as
+// unpacking their packets one by one. The messages cross the wrap at different packets, and some packets
+// are rejected: truncated, or with a broken start of block.
+TEST(DecodePool, MatchesSequentialDecoding)
+{
+  using namespace pandar64;
+  // 300 packets per rotation
+  PacketStream stream(100, 20);
+  std::vector<std::vector<uint8_t>> packets;
+  for (size_t i = 0; i < 1500; ++i) {
+    std::vector<uint8_t> packet = stream.pandar64(STRONGEST_RETURN);
+    if (i % 97 == 50) {
+      packet.resize(packet.size() - 20);
+    }
+    else if (i % 89 == 7) {
+      packet[0] = 0;
+    }
+    packets.push_back(packet);
+  }
+  // messages of 1 to 306 packets
+  std::vector<size_t> message_sizes;
+  for (size_t packet = 0, size = 1; packet < packets.size(); packet += size, size = size % 250 + 61) {
+    message_sizes.push_back(std::min(size, packets.size() - packet));
+  }
+
+  Calibration calibration = testCalibration();
+  for (bool organized : { false, true }) {
+    SCOPED_TRACE(organized);
+    Pandar64Decoder sequential(calibration, 0.0f, 0.1, Pandar64Decoder::ReturnMode::STRONGEST);
+    if (organized) {
+      sequential.setOrganized(0.2, 1);
+    }
+    std::vector<PointcloudXYZIRADT> expected;
+    for (const auto& packet : packets) {
+      sequential.unpack(packet.data(), packet.size());
+      if (sequential.hasScanned()) {
+        expected.push_back(sequential.getPointcloud());
+      }
+    }
+    ASSERT_EQ(expected.size(), 5u);
+
+    for (size_t threads : { 1, 2, 4 }) {
+      SCOPED_TRACE(threads);
+      Pandar64Decoder decoder(calibration, 0.0f, 0.1, Pandar64Decoder::ReturnMode::STRONGEST);
+      if (organized) {
+        decoder.setOrganized(0.2, 1);
+      }
+      DecodePool pool(decoder, threads);
+      std::vector<PointcloudXYZIRADT> scans;
+      size_t sliced_messages = 0;
+      size_t first = 0;
+      for (size_t size : message_sizes) {
+        std::vector<DecodePool::Packet> message;
+        for (size_t i = first; i < first + size; ++i) {
+          message.push_back({ packets[i].data(), packets[i].size() });
+        }
+        first += size;
+        const size_t slice_count = pool.decode(message);
+        sliced_messages += slice_count > 1 ? 1 : 0;
+        size_t replayed = 0;
+        for (size_t i = 0; i < slice_count; ++i) {
+          const PacketDecoder::Slice& slice = pool.slice(i);
+          for (size_t packet = 0; packet < slice.packets.size(); ++packet, ++replayed) {
+            decoder.replay(slice, packet);
+            if (decoder.hasScanned()) {
+              scans.push_back(decoder.getPointcloud());
+            }
+          }
+        }
+        ASSERT_EQ(replayed, size);
+      }
+      if (threads > 1) {
+        EXPECT_GT(sliced_messages, 0u);
+      }
+
+      ASSERT_EQ(scans.size(), expected.size());
+      for (size_t i = 0; i < scans.size(); ++i) {
+        SCOPED_TRACE(i);
+        expectSameScan(scans[i], expected[i]);
+      }
+      expectSameScan(decoder.getPartialPointcloud(), sequential.getPartialPointcloud());
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
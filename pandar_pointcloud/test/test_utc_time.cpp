@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <ctime>
+#include "pandar_pointcloud/decoder/utc_time.hpp"
+
+using pandar_pointcloud::UtcEpochCache;
+using pandar_pointcloud::utcToEpoch;
+
+namespace
+{
+int64_t referenceEpoch(int year, int month, int day, int hour, int minute, int second)
+{
+  std::tm t{};
+  t.tm_year = year - 1900;
+  t.tm_mon = month - 1;
+  t.tm_mday = day;
+  t.tm_hour = hour;
+  t.tm_min = minute;
+  t.tm_sec = second;
+  return timegm(&t);
+}
+}  // namespace
+
+TEST(UtcTime, MatchesTimegm)
+{
+  for (int year = 1970; year < 2100; year += 7) {
+    for (int month = 1; month <= 12; ++month) {
+      for (int day : { 1, 15, 28 }) {
+        EXPECT_EQ(utcToEpoch(year, month, day, 23, 59, 58), referenceEpoch(year, month, day, 23, 59, 58))
+            << year << "-" << month << "-" << day;
+      }
+    }
+  }
+  // leap days and the turn of a century
+  EXPECT_EQ(utcToEpoch(2000, 2, 29, 12, 0, 0), referenceEpoch(2000, 2, 29, 12, 0, 0));
+  EXPECT_EQ(utcToEpoch(2024, 2, 29, 0, 0, 1), referenceEpoch(2024, 2, 29, 0, 0, 1));
+  EXPECT_EQ(utcToEpoch(2100, 3, 1, 0, 0, 0), referenceEpoch(2100, 3, 1, 0, 0, 0));
+}
+
+// Most sensors send the year since 2000. Some firmware sends struct tm's years since 1900, which the old
+// decoders passed to timegm as is. Both must give the same epoch. The old 128E4X decoder read the year since
+// 2000 as tm_year too, and stamped 2022 scans as 1922.
+TEST(UtcTime, YearEncodings)
+{
+  const int64_t expected = referenceEpoch(2022, 5, 17, 10, 11, 12);
+  const uint8_t since_2000[6] = { 22, 5, 17, 10, 11, 12 };
+  const uint8_t since_1900[6] = { 122, 5, 17, 10, 11, 12 };
+  UtcEpochCache cache;
+  EXPECT_EQ(cache.epoch(since_2000), expected);
+  EXPECT_EQ(cache.epoch(since_1900), expected);
+  EXPECT_EQ(UtcEpochCache().epoch(since_1900), expected);
+  EXPECT_EQ(UtcEpochCache().epoch(since_2000), expected);
+}
+
+TEST(UtcTime, CacheFollowsTheField)
+{
+  UtcEpochCache cache;
+  uint8_t utc[6] = { 22, 12, 31, 23, 59, 59 };
+  const int64_t first = cache.epoch(utc);
+  EXPECT_EQ(cache.epoch(utc), first);
+  utc[5] = 58;
+  EXPECT_EQ(cache.epoch(utc), first - 1);
+  // the next year
+  const uint8_t next[6] = { 23, 1, 1, 0, 0, 0 };
+  EXPECT_EQ(cache.epoch(next), first + 1);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}